@@ -5,6 +5,7 @@
 #include <sstream>
 #include <iomanip>
 #include <vector>
+#include <set>
 #include <cmath>
 #include <limits>
 #include <opencv2/core.hpp>
@@ -19,6 +20,9 @@
 #include "objectDetection2D.hpp"
 #include "lidarData.hpp"
 #include "camFusion.hpp"
+#include "stageTiming.hpp"
+#include "briefDescriptor.hpp"
+#include "matchingKernels.hpp"
 
 using namespace std;
 
@@ -45,6 +49,17 @@ int main(int argc, const char *argv[])
     string yoloModelConfiguration = yoloBasePath + "yolov3.cfg";
     string yoloModelWeights = yoloBasePath + "yolov3.weights";
 
+    // optional : choose model / input resolution per frame from a latency budget (profiles ordered from cheapest to most accurate)
+    bool bAdaptiveYolo = false;
+    double yoloLatencyBudget = 60.0; // [ms] share of the 100 ms frame deadline which may be spent in YOLO
+    vector<YoloProfile> yoloProfiles = {
+        {"yolov3-tiny@320", yoloBasePath + "yolov3-tiny.cfg", yoloBasePath + "yolov3-tiny.weights", 320, -1.0},
+        {"yolov3@416", yoloModelConfiguration, yoloModelWeights, 416, -1.0},
+        {"yolov3@608", yoloModelConfiguration, yoloModelWeights, 608, -1.0}};
+    int yoloProfileIdx = 1; // yolov3@416, used as fixed profile if bAdaptiveYolo is false
+    if (bAdaptiveYolo) // yolov3-tiny is not part of the repository (see README), profiles without model files are skipped
+        yoloProfileIdx = removeUnavailableYoloProfiles(yoloProfiles, yoloProfileIdx);
+
     // Lidar
     string lidarPrefix = "KITTI/2011_09_26/velodyne_points/data/000000";
     string lidarFileType = ".bin";
@@ -73,46 +88,198 @@ int main(int argc, const char *argv[])
     int dataBufferSize = 2;       // no. of images which are held in memory (ring buffer) at the same time
     vector<DataFrame> dataBuffer; // list of data frames which are held in memory at the same time
     bool bVis = false;            // visualize results
+    bool bLidarGuidedROI = false; // run YOLO only on the image region covered by the cropped ego lane Lidar points
+    bool bROIMask = false;        // restrict keypoint detection, description and matching to the dilated YOLO ROIs
+    bool bTiledDetection = false; // detect keypoints on horizontal image strips in parallel (ORB, HARRIS, SHITOMASI run untiled)
+    int nDetectionStrips = cv::getNumThreads();
+    bool bAdaptiveThreshold = false; // adjust the FAST / BRISK threshold per frame to track a keypoint budget
+    int targetKeypoints = 1500;      // keypoint budget per frame for the adaptive threshold
+    bool bBucketKpts = false;     // keep the strongest keypoints per grid cell
+    bool bWarmUp = true;          // run all stages once before timing starts, so cold-start latency is reported separately
+    bool bBenchmarkHarrisNMS = false; // compare local-maximum Harris NMS with the original overlap NMS on all frames
+    bool bSinglePass = false;     // use detectAndCompute for same-family pairs (ORB, AKAZE, BRISK, SIFT) instead of detect + compute
+    // descriptor length : BRIEF / BRIEF_SIMD bytes (16, 32, 64) and orientation, AKAZE descriptor_size in bits (0 : full),
+    // ORB WTA_K (2, 3, 4), leading FREAK bytes (16, 32, 64)
+    DescriptorLengthConfig descriptorLength = {32, false, 0, 2, 64};
+    bool bDescriptorLengthSweep = false; // run every detector / descriptor pair once per distinct setting of descriptorLengthSweep
+    vector<DescriptorLengthConfig> descriptorLengthSweep = {{64, false, 0, 2, 64}, {32, false, 256, 3, 32}, {16, false, 128, 4, 16}};
+    bool bBenchmarkBRIEF = false; // compare the in-tree BRIEF (SIMD and scalar) with the OpenCV extractor on all frames
+    bool bBenchmarkMIH = false;   // compare multi-index hashing with brute-force Hamming matching on synthetic descriptors
+    bool bBenchmarkLSH = false;   // recall and build / query time of the FLANN LSH index against brute force (FAST / BRIEF)
+    bool bBenchmarkHNSW = false;  // compare the HNSW graph index with brute force on SIFT descriptors (recall / latency per efSearch)
+    bool bQuantizeSIFT = false;   // store SIFT descriptors as uint8 (4x less memory), MAT_BF then matches them with the integer L2 kernel
+    bool bBenchmarkQuantizedSIFT = false; // compare uint8 SIFT matching (with / without float re-ranking) with float brute force
+    bool bBenchmarkHamming = false; // compare the SIMD Hamming kNN-2 kernel with BFMatcher on random descriptors
+    bool bParallelDesc = false;   // extract descriptors of keypoint chunks concurrently (BRIEF, FREAK, BRISK, ORB; AKAZE and SIFT run unchunked)
+    int nDescChunks = cv::getNumThreads(); // no. of keypoint chunks for parallel description
+    bool bGuidedMatching = false; // match only within a window around the position predicted from the per-box keypoint flow
+    float guidedSearchRadius = 40; // search window radius of guided matching in pixels
+    bool bBoxPairMatching = false; // associate bounding boxes first, then match descriptors only within each box pair
+    bool bKLTTracking = false;    // track keypoints with Lucas-Kanade instead of describing and matching them on every frame
+    float kltMaxFBError = 1.0;    // max. forward-backward error of a KLT track in pixels
     ofstream resOut;              // TTC result file 
     bool bresultFileSave = false;
     bool bFirstLine = false;
     if(bresultFileSave){resOut.open("../data/TTCresult.txt");}
+    setDescriptorLengthConfig(descriptorLength);
+    setLshParameters(12, 20, 2); // MAT_FLANN on binary descriptors : LSH tables, key size, multi-probe level
+    setHnswParameters(16, 100, 64); // MAT_HNSW on float descriptors : max. links per node, efConstruction, efSearch
+    if (bBenchmarkHamming)
+        benchmarkHammingKnn2(2000, 2000);
+    if (bBenchmarkMIH)
+        benchmarkMih(2000, 20000, 20);
+    if (bBenchmarkHarrisNMS || bBenchmarkBRIEF || bBenchmarkLSH || bBenchmarkHNSW || bBenchmarkQuantizedSIFT)
+    {
+        vector<cv::Mat> benchImages;
+        for (size_t imgIndex = 0; imgIndex <= imgEndIndex - imgStartIndex; imgIndex += imgStepWidth)
+        {
+            ostringstream imgNumber;
+            imgNumber << setfill('0') << setw(imgFillWidth) << imgStartIndex + imgIndex;
+            cv::Mat benchGray;
+            cv::cvtColor(cv::imread(imgBasePath + imgPrefix + imgNumber.str() + imgFileType), benchGray, cv::COLOR_BGR2GRAY);
+            benchImages.push_back(benchGray);
+        }
+        if (bBenchmarkHarrisNMS)
+            benchmarkHarrisNMS(benchImages);
+        if (bBenchmarkBRIEF)
+            benchmarkBRIEF(benchImages);
+        if (bBenchmarkLSH)
+            benchmarkLSH(benchImages, "FAST", "BRIEF");
+        if (bBenchmarkHNSW)
+            benchmarkHnsw(benchImages, "FAST");
+        if (bBenchmarkQuantizedSIFT)
+            benchmarkQuantizedSift(benchImages, "FAST");
+    }
+
     /* MAIN LOOP OVER ALL IMAGES */
     // available detectorTypes
     // std::vector<string> detectorTypeVec = {"SHITOMASI", "HARRIS", "FAST", "BRISK", "ORB", "AKAZE", "SIFT"};
     std::vector<string> detectorTypeVec = {"FAST"};
     // available descriptorTypes
-    // std::vector<string> descriptorTypeVec = { "BRISK", "BRIEF", "ORB", "FREAK", "AKAZE", "SIFT"};
+    // std::vector<string> descriptorTypeVec = { "BRISK", "BRIEF", "BRIEF_SIMD", "ORB", "FREAK", "AKAZE", "SIFT"};
     std::vector<string> descriptorTypeVec = {"BRIEF"};
+    // descriptor runs : every descriptor with descriptorLength, or once per sweep setting that changes its length
+    vector<pair<string, DescriptorLengthConfig>> descriptorRuns;
+    for (auto it = descriptorTypeVec.begin(); it != descriptorTypeVec.end(); ++it)
+    {
+        vector<DescriptorLengthConfig> lengths = bDescriptorLengthSweep ? descriptorLengthSweep : vector<DescriptorLengthConfig>(1, descriptorLength);
+        set<string> labels;
+        for (auto length = lengths.begin(); length != lengths.end(); ++length)
+            if (labels.insert(descriptorLengthLabel(*it, *length)).second)
+                descriptorRuns.push_back(make_pair(*it, *length));
+    }
     std::vector<TTCresult> TTCresultVec;
     int TTCcalModel = 0; // 0 - CVM(Constant Velocity Model), 1 - CAM (Conatant Acceleration Model)
     for (auto it1 = detectorTypeVec.begin(); it1!=detectorTypeVec.end(); it1++)
     {  
-        for (auto it2 = descriptorTypeVec.begin(); it2!=descriptorTypeVec.end(); it2++)
+        for (auto it2 = descriptorRuns.begin(); it2!=descriptorRuns.end(); it2++)
         {   
             // dataBuffer clear for new detector and descriptor set
             dataBuffer.clear();
+            setDescriptorLengthConfig(it2->second);
 
             // detectorType AKAZE need to be matched with descriptorType AKAZE
-            if ((*it1) == "AKAZE" && (*it2) != "AKAZE")
+            if ((*it1) == "AKAZE" && it2->first != "AKAZE")
                 continue; 
-            if ((*it1) != "AKAZE" && (*it2) == "AKAZE")
+            if ((*it1) != "AKAZE" && it2->first == "AKAZE")
                 continue;
             // detectorType SIFT can't be used with descriptorType ORB
-            if((*it1) == "SIFT" && (*it2) == "ORB")
+            if((*it1) == "SIFT" && it2->first == "ORB")
                 continue;
             TTCresult TTCresult;
             TTCresult.detectorType = (*it1);
-            TTCresult.descriptorType = (*it2);
+            TTCresult.descriptorType = it2->first;
+            TTCresult.descriptorLength = descriptorLengthLabel(it2->first, it2->second);
+            TTCresult.matchingTime = 0;
+            TTCresult.nMatchedFrames = 0;
             cout << "============================================="<<endl;
             cout << "TTCresult.detectorType: " << TTCresult.detectorType << endl;
-            cout << "TTCresult.descriptorType " << TTCresult.descriptorType << endl;
+            cout << "TTCresult.descriptorType " << TTCresult.descriptorType << " (" << TTCresult.descriptorLength << ")" << endl;
             cout << "============================================="<<endl;
 
+            // resolve detector and descriptor once per combination (fails loudly for unknown names), the instances are
+            // handed to the per-frame calls so the factory is not searched again
+            cv::Ptr<cv::FeatureDetector> detector;
+            KeypointDetectorFn detectKeypoints = getKeypointDetector(*it1, &detector);
+            cv::Ptr<cv::DescriptorExtractor> extractor;
+            if (it2->first != "BRIEF_SIMD") // the in-tree BRIEF is not part of the factory
+                extractor = getDescriptorExtractor(it2->first);
+
+            // single pass only when no keypoint post-selection runs between detection and description
+            bool bDetAndDesc = bSinglePass && isSinglePassPair(*it1, it2->first) && !bTiledDetection && !bBucketKpts;
+            if (bDetAndDesc)
+                cout << "single-pass detectAndCompute for " << (*it1) << endl;
+
+            // keypoint budget controller for detectors with an adjustable threshold (FAST, BRISK)
+            ThresholdController thresholdController = {(*it1) == "BRISK" ? 30.0 : 70.0, 5.0, 250.0, targetKeypoints, 0.5, 1.5, 0};
+            bool bControlThreshold = bAdaptiveThreshold && setDetectorThreshold(*it1, thresholdController.threshold);
+            if (bControlThreshold)
+                detector = getDetector(*it1); // BRISK gets a new instance for every threshold
+
+            // matcher configuration, the matcher keeps the previous frame's descriptors indexed between frames
+            string matcherType = "MAT_BF";        // MAT_BF, MAT_FLANN, MAT_MIH (256-bit binary descriptors), MAT_HNSW (float descriptors)
+            string descriptorDataType = getDescriptorDataType(it2->first); // DES_BINARY, DES_BINARY2 (ORB WTA_K 3 / 4), DES_HOG
+            string selectorType = "SEL_KNN";       // SEL_NN, SEL_KNN
+            FrameMatcher frameMatcher;
+            initFrameMatcher(frameMatcher, matcherType, descriptorDataType);
+            bool bUseFrameMatcher = !bKLTTracking && !bGuidedMatching && !bBoxPairMatching; // other modes match without the indexed train set
+
             // for constant acceleration model
             double vehicleVel = -1e9;
             double vehicleAcc = -1e9;
 
+            // WARM-UP : run every configured stage once on a representative frame before the timed loop, so that lazy
+            // allocations and kernel selection show up as cold-start latency instead of skewing the first frame
+            if (bWarmUp)
+            {
+                setStageTimingWarmUp(true); // only the first use of a stage counts as cold, not every combination's warm-up
+                ostringstream imgNumber;
+                imgNumber << setfill('0') << setw(imgFillWidth) << imgStartIndex;
+                cv::Mat warmUpImg = cv::imread(imgBasePath + imgPrefix + imgNumber.str() + imgFileType);
+                ImagePlanes warmUpPlanes;
+                initImagePlanes(warmUpPlanes, warmUpImg);
+                cv::Mat &warmUpGray = warmUpPlanes.gray;
+
+                vector<BoundingBox> warmUpBoxes;
+                double warmUpInferenceTime;
+                YoloProfile &warmUpProfile = yoloProfiles[yoloProfileIdx];
+                detectObjects(warmUpImg, warmUpBoxes, 0.2, 0.4, yoloBasePath, yoloClassesFile, warmUpProfile.modelConfiguration,
+                              warmUpProfile.modelWeights, false, nullptr, warmUpProfile.inputSize, &warmUpInferenceTime);
+                recordStageTime("YOLO " + warmUpProfile.name, warmUpInferenceTime);
+
+                vector<cv::KeyPoint> warmUpKeypoints;
+                cv::Mat warmUpDescriptors;
+                if (bDetAndDesc)
+                    detAndDescKeypoints(warmUpKeypoints, warmUpGray, warmUpDescriptors, (*it1), cv::Mat(), detector);
+                else
+                {
+                    if (bTiledDetection)
+                        detKeypointsTiled(warmUpKeypoints, warmUpGray, (*it1), nDetectionStrips, false);
+                    else
+                        detectKeypoints(warmUpKeypoints, warmUpGray, false, cv::Mat(), detector);
+                    if (bParallelDesc && it2->first != "BRIEF_SIMD")
+                        descKeypointsChunked(warmUpKeypoints, warmUpGray, warmUpDescriptors, it2->first, nDescChunks);
+                    else
+                        descKeypoints(warmUpKeypoints, warmUpPlanes, warmUpDescriptors, it2->first, extractor);
+                }
+                if (bQuantizeSIFT && descriptorDataType == "DES_HOG")
+                    quantizeDescriptors(warmUpDescriptors, warmUpDescriptors);
+
+                vector<cv::DMatch> warmUpMatches;
+                FrameMatcher warmUpMatcher;
+                initFrameMatcher(warmUpMatcher, matcherType, descriptorDataType);
+                advanceFrameMatcher(warmUpMatcher, warmUpDescriptors);
+                matchToPreviousFrame(warmUpMatcher, warmUpDescriptors, warmUpMatches, selectorType);
+                if (bKLTTracking)
+                {
+                    vector<cv::KeyPoint> warmUpTracked;
+                    trackKeypointsKLT(warmUpKeypoints, warmUpPlanes, warmUpPlanes, warmUpTracked, warmUpMatches, kltMaxFBError);
+                }
+
+                setStageTimingWarmUp(false);
+                cout << "#0 : WARM-UP done" << endl;
+            }
+
             for (size_t imgIndex = 0; imgIndex <= imgEndIndex - imgStartIndex; imgIndex+=imgStepWidth)
             {
                 /* LOAD IMAGE INTO BUFFER */
@@ -142,18 +309,6 @@ int main(int argc, const char *argv[])
                 cout << "#1 : LOAD IMAGE INTO BUFFER done" << endl;
 
 
-                /* DETECT & CLASSIFY OBJECTS */
-
-                float confThreshold = 0.2;
-                float nmsThreshold = 0.4;
-                // DETECT & CLASSIFY OBJECTS based on YOLO
-                // output -> boundingBoxes        
-                detectObjects((dataBuffer.end() - 1)->cameraImg, (dataBuffer.end() - 1)->boundingBoxes, confThreshold, nmsThreshold,
-                            yoloBasePath, yoloClassesFile, yoloModelConfiguration, yoloModelWeights, bVis);
-
-                cout << "#2 : DETECT & CLASSIFY OBJECTS done" << endl;
-
-
                 /* CROP LIDAR POINTS */
 
                 // load 3D Lidar points from file
@@ -167,7 +322,46 @@ int main(int argc, const char *argv[])
             
                 (dataBuffer.end() - 1)->lidarPoints = lidarPoints;
 
-                cout << "#3 : CROP LIDAR POINTS done" << endl;
+                cout << "#2 : CROP LIDAR POINTS done" << endl;
+
+
+                /* DETECT & CLASSIFY OBJECTS */
+
+                float confThreshold = 0.2;
+                float nmsThreshold = 0.4;
+
+                // optional : only run YOLO on the image region covered by the ego lane Lidar points
+                // (falls back to the full image if no Lidar point is left after cropping)
+                cv::Rect detROI;
+                if (bLidarGuidedROI)
+                {
+                    float envMinZ = -1.73, envMaxZ = 1.5; // vehicle envelope from road surface (sensor height 1.73 m) to ~3.2 m above it
+                    float envMarginY = 1.0;              // lateral margin in [m] around the Lidar points
+                    int envMarginPx = 20;                // additional margin in pixels
+                    detROI = computeLidarImageROI((dataBuffer.end() - 1)->lidarPoints, P_rect_00, R_rect_00, RT, img.size(),
+                                                  envMinZ, envMaxZ, envMarginY, envMarginPx);
+                    cout << "Lidar guided YOLO ROI : " << detROI << endl;
+                }
+
+                // select model / resolution profile for this frame
+                if (bAdaptiveYolo)
+                {
+                    yoloProfileIdx = selectYoloProfile(yoloProfiles, yoloProfileIdx, yoloLatencyBudget);
+                }
+                YoloProfile &yoloProfile = yoloProfiles[yoloProfileIdx];
+
+                // DETECT & CLASSIFY OBJECTS based on YOLO
+                // output -> boundingBoxes        
+                double yoloInferenceTime;
+                detectObjects((dataBuffer.end() - 1)->cameraImg, (dataBuffer.end() - 1)->boundingBoxes, confThreshold, nmsThreshold,
+                            yoloBasePath, yoloClassesFile, yoloProfile.modelConfiguration, yoloProfile.modelWeights, bVis,
+                            detROI.area() > 0 ? &detROI : nullptr, yoloProfile.inputSize, &yoloInferenceTime);
+                updateYoloProfileTiming(yoloProfile, yoloInferenceTime);
+                recordStageTime("YOLO " + yoloProfile.name, yoloInferenceTime);
+                cout << "YOLO profile " << yoloProfile.name << " inference in " << yoloInferenceTime << " ms (avg "
+                     << yoloProfile.avgInferenceTime << " ms)" << endl;
+
+                cout << "#3 : DETECT & CLASSIFY OBJECTS done" << endl;
 
 
                 /* CLUSTER LIDAR POINT CLOUD */
@@ -192,39 +386,80 @@ int main(int argc, const char *argv[])
 
                 /* DETECT IMAGE KEYPOINTS */
 
-                // convert current image to grayscale
-                cv::Mat imgGray;
-                cv::cvtColor((dataBuffer.end()-1)->cameraImg, imgGray, cv::COLOR_BGR2GRAY);
+                // convert current image to grayscale once, detection and description both work on the frame planes
+                initImagePlanes((dataBuffer.end()-1)->planes, (dataBuffer.end()-1)->cameraImg);
+                cv::Mat &imgGray = (dataBuffer.end()-1)->planes.gray;
 
                 // extract 2D keypoints from current image
                 vector<cv::KeyPoint> keypoints; // create empty feature list for current image
+                cv::Mat descriptors;            // filled here in single-pass mode, otherwise in the description stage
+                vector<cv::DMatch> trackMatches; // correspondences with the previous frame in KLT mode
+
+                // in KLT mode keypoints are carried forward from the previous frame, a full detection runs on the first frame only
+                bool bTrackFrame = bKLTTracking && dataBuffer.size() > 1;
                 
                     // Available detectorType options: SHITOMASI, HARRIS, FAST, BRISK, ORB, AKAZE, SIFT
                     // string detectorType = "FAST";
                     // double detKeypoingTime, descriptorExtractTime;
                     // int matchSize;
 
-                    if ((*it1).compare("SHITOMASI") == 0)
-                        detKeypointsShiTomasi(keypoints, imgGray, false);
-                    else if((*it1).compare("HARRIS") == 0)
-                        detKeypointsHarris(keypoints, imgGray, false);
-                    else if((*it1).compare("FAST") == 0)
-                        detKeypointsFAST(keypoints, imgGray, false);
-                    else if((*it1).compare("BRISK") == 0)
-                        detKeypointsBRISK(keypoints, imgGray, false);
-                    else if((*it1).compare("ORB") == 0)
-                        detKeypointsORB(keypoints, imgGray, false);
-                    else if((*it1).compare("AKAZE") == 0)
-                        detKeypointsAKAZE(keypoints, imgGray, false);
-                    else if((*it1).compare("SIFT") == 0)
-                        detKeypointsSIFT(keypoints, imgGray, false);
-                    else{
-                        cout <<"detectorType: " << (*it1) << " is not in available options s" << "\n";
+                    // optional : only detect / describe / match keypoints inside the (dilated) YOLO ROIs of the current frame
+                    cv::Mat detMask;
+                    if (bROIMask)
+                    {
+                        int maskDilatePx = 20; // margin around each bounding box in pixels
+                        detMask = createROIMask((dataBuffer.end() - 1)->boundingBoxes, imgGray.size(), maskDilatePx);
+                    }
+
+                    if (bControlThreshold)
+                    {
+                        setDetectorThreshold(*it1, thresholdController.threshold);
+                        detector = getDetector(*it1); // BRISK gets a new instance for every threshold
+                    }
+
+                    if (bTrackFrame)
+                    {
+                        int gridCols = 16, gridRows = 6; // same grid as for bucketing
+                        int minPerCell = 5, maxPerCell = 20;
+                        trackKeypointsKLT((dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 2)->planes,
+                                          (dataBuffer.end() - 1)->planes, keypoints, trackMatches, kltMaxFBError);
+                        refillKeypoints(keypoints, imgGray, detectKeypoints, detector, gridCols, gridRows, minPerCell, maxPerCell, detMask);
+                    }
+                    else if (bDetAndDesc)
+                        detAndDescKeypoints(keypoints, imgGray, descriptors, (*it1), detMask, detector);
+                    else if (bTiledDetection)
+                        detKeypointsTiled(keypoints, imgGray, (*it1), nDetectionStrips, false, detMask);
+                    else
+                        detectKeypoints(keypoints, imgGray, false, detMask, detector);
+
+                    if (bControlThreshold && !bTrackFrame)
+                    {
+                        double usedThreshold = thresholdController.threshold;
+                        updateThresholdController(thresholdController, keypoints.size());
+                        cout << (*it1) << " threshold " << cvRound(usedThreshold) << " -> n= " << keypoints.size() << " keypoints (target "
+                             << thresholdController.targetCount << "), next threshold " << cvRound(thresholdController.threshold) << endl;
+                    }
+
+                    // detectors with an image pyramid may still report keypoints outside the mask,
+                    // remove them before descriptors are extracted (single pass already applied the mask during detection)
+                    // (tracked keypoints keep their index in the matches, so they are not filtered either)
+                    if (bROIMask && !bDetAndDesc && !bTrackFrame)
+                    {
+                        cv::KeyPointsFilter::runByPixelsMask(keypoints, detMask);
                     }
 
                     // optional : limit number of keypoints (helpful for debugging and learning)
+                    // optional : spread keypoints evenly over the image and bound the no. of keypoints for description and matching
+                    if (bBucketKpts && !bTrackFrame)
+                    {
+                        int gridCols = 16, gridRows = 6; // ~78x63 pixel cells on KITTI images
+                        int maxPerCell = 20;
+                        int maxTotal = 1000;
+                        bucketKeypoints(keypoints, imgGray.size(), gridCols, gridRows, maxPerCell, maxTotal);
+                    }
+
                     bool bLimitKpts = false;
-                    if (bLimitKpts)
+                    if (bLimitKpts && !bDetAndDesc && !bTrackFrame)
                     {
                         int maxKeypoints = 50;
 
@@ -244,8 +479,15 @@ int main(int argc, const char *argv[])
 
                     /* EXTRACT KEYPOINT DESCRIPTORS */
 
-                    cv::Mat descriptors;
-                    descKeypoints((dataBuffer.end() - 1)->keypoints, (dataBuffer.end() - 1)->cameraImg, descriptors, (*it2));
+                    if (!bDetAndDesc && !bKLTTracking)
+                    {
+                        if (bParallelDesc && it2->first != "BRIEF_SIMD")
+                            descKeypointsChunked((dataBuffer.end() - 1)->keypoints, (dataBuffer.end() - 1)->planes.gray, descriptors, it2->first, nDescChunks);
+                        else
+                            descKeypoints((dataBuffer.end() - 1)->keypoints, (dataBuffer.end() - 1)->planes, descriptors, it2->first, extractor);
+                    }
+                    if (bQuantizeSIFT && descriptorDataType == "DES_HOG")
+                        quantizeDescriptors(descriptors, descriptors);
                     
 
                     // push descriptors for current frame to end of data buffer
@@ -259,21 +501,26 @@ int main(int argc, const char *argv[])
 
                         /* MATCH KEYPOINT DESCRIPTORS */
 
-                        vector<cv::DMatch> matches;
-                        string matcherType = "MAT_BF";        // MAT_BF, MAT_FLANN
-                        string descriptorDataType = "DES_BINARY"; // DES_BINARY, DES_HOG
-                        string selectorType = "SEL_KNN";       // SEL_NN, SEL_KNN
-                        
-                        // change descriptorDataType into DES_HOG when descriptorType is SIFT.
-                        if((*it2) == "SIFT"){ descriptorDataType = "DES_HOG"; }
+                        // in box-pair mode descriptors are matched per box pair after the bounding box association below
+                        bool bMatchBoxPairs = bBoxPairMatching && !bKLTTracking && !bGuidedMatching;
 
-                        matchDescriptors((dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints,
-                                        (dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors,
-                                        matches, descriptorDataType, matcherType, selectorType);
+                        double tMatching = (double)cv::getTickCount();
+                        vector<cv::DMatch> matches;
+                        if (bKLTTracking)
+                            matches = trackMatches;
+                        else if (bGuidedMatching)
+                            matchDescriptorsGuided(*(dataBuffer.end() - 2), *(dataBuffer.end() - 1), matches, descriptorDataType, guidedSearchRadius);
+                        else if (!bMatchBoxPairs)
+                            matchToPreviousFrame(frameMatcher, (dataBuffer.end() - 1)->descriptors, matches, selectorType);
+                        tMatching = ((double)cv::getTickCount() - tMatching) / cv::getTickFrequency();
 
                         // store matches in current data frame
                         (dataBuffer.end() - 1)->kptMatches = matches;
 
+                        // keypoint motion per box, predicts the search windows of guided matching in the next frame
+                        if (bGuidedMatching)
+                            computeBoxFlow(*(dataBuffer.end() - 2), *(dataBuffer.end() - 1));
+
                         cout << "#7 : MATCH KEYPOINT DESCRIPTORS done" << endl;
 
                         // visualize matches between current and previous image
@@ -287,7 +534,7 @@ int main(int argc, const char *argv[])
                                             cv::Scalar::all(-1), cv::Scalar::all(-1),
                                             vector<char>(), cv::DrawMatchesFlags::DRAW_RICH_KEYPOINTS);
 
-                            string windowName = (*it1) + "-"+ (*it2) + " Matching keypoints between two camera images";
+                            string windowName = (*it1) + "-"+ it2->first + " Matching keypoints between two camera images";
                             cv::namedWindow(windowName, 7);
                             cv::imshow(windowName, matchImg);
                             cout << "Press key to continue to next image" << endl << endl;
@@ -303,6 +550,19 @@ int main(int argc, const char *argv[])
                         map<int, int> bbBestMatches;
                         matchBoundingBoxes(matches, bbBestMatches, *(dataBuffer.end()-2), *(dataBuffer.end()-1)); // associate bounding boxes between current and previous frame using keypoint matches
                         //// EOF STUDENT ASSIGNMENT
+
+                        // box-pair mode : per-box matches, the frame matches are their union (for visualization)
+                        map<int, vector<cv::DMatch>> boxKptMatches;
+                        if (bMatchBoxPairs)
+                        {
+                            double t = (double)cv::getTickCount();
+                            matchBoxPairs(*(dataBuffer.end() - 2), *(dataBuffer.end() - 1), bbBestMatches, descriptorDataType, boxKptMatches);
+                            tMatching += ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+                            for (auto it = boxKptMatches.begin(); it != boxKptMatches.end(); ++it)
+                                (dataBuffer.end() - 1)->kptMatches.insert((dataBuffer.end() - 1)->kptMatches.end(), it->second.begin(), it->second.end());
+                        }
+                        TTCresult.matchingTime += 1000 * tMatching;
+                        TTCresult.nMatchedFrames++;
                         
                         // Visualize matched bounding boxes
                         if(bVis){
@@ -375,7 +635,8 @@ int main(int argc, const char *argv[])
                                 //// TASK FP.3 -> assign enclosed keypoint matches to bounding box (implement -> clusterKptMatchesWithROI)
                                 //// TASK FP.4 -> compute time-to-collision based on camera (implement -> computeTTCCamera)
                                 double ttcCamera;
-                                clusterKptMatchesWithROI(*currBB, (dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints, (dataBuffer.end() - 1)->kptMatches);                    
+                                clusterKptMatchesWithROI(*currBB, (dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints,
+                                                         bMatchBoxPairs ? boxKptMatches[currBB->boxID] : (dataBuffer.end() - 1)->kptMatches);
                                 computeTTCCamera((dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints, currBB->kptMatches, sensorFrameRate, ttcCamera);
                                 // //// EOF STUDENT ASSIGNMENT
                                 
@@ -416,11 +677,22 @@ int main(int argc, const char *argv[])
 
                     }
 
+                    // the current frame's descriptors become the indexed train set for matching the next frame
+                    if (bUseFrameMatcher)
+                        advanceFrameMatcher(frameMatcher, (dataBuffer.end() - 1)->descriptors);
+
             } // eof loop over all images
             TTCresultVec.push_back(TTCresult);
         }// eof loop over all descriptor options 
     }// eof loop over all detector options 
 
+    // cold-start versus steady-state latency of all stages
+    printStageTimings();
+
+    // matching time versus camera TTC stability of the descriptor length settings
+    if (bDescriptorLengthSweep)
+        printTTCStability(TTCresultVec);
+
     if(bresultFileSave){
         for (auto it1= TTCresultVec.begin(); it1!=TTCresultVec.end(); it1++){
             TTCresult TTCresultTemp = (*it1);
@@ -0,0 +1,291 @@
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/features2d.hpp>
+#include <opencv2/xfeatures2d.hpp>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BRIEF_X86_SIMD 1
+#endif
+
+#include "briefDescriptor.hpp"
+#include "matching2D.hpp"
+
+using namespace std;
+
+// geometry of the descriptor, identical to cv::xfeatures2d::BriefDescriptorExtractor : a 48x48 patch sampled on 9x9 box sums,
+// keypoints closer than patch / 2 + kernel / 2 = 28 pixels to the image border are removed
+static const int briefPatchRadius = 24;
+static const int briefBorder = 28;
+static const int briefArenaRows = 4096; // minimum no. of rows of a descriptor block, enough for the FAST keypoints of a frame
+
+// Sampling pairs of cv::xfeatures2d::BriefDescriptorExtractor (opencv_contrib generated_16/32/64.i) as {y1, x1, y2, x2}
+// offsets from the keypoint, one line per descriptor byte. The 16 and 32 byte patterns are the first 128 / 256 pairs of the
+// 64 byte pattern. Pair 8 * i + j sets bit j of byte i (the generated code lists the pairs of a byte from bit 7 down to 0).
+static const signed char briefPairs[512][4] = {
+    {-11,8,-15,5}, {-2,8,2,4}, {-14,5,5,-3}, {13,2,-1,0}, {1,6,-10,-7}, {1,-2,11,2}, {-14,-1,-3,3}, {-2,-1,7,-1},
+    {-1,14,-5,-14}, {14,7,8,5}, {22,-2,-11,-8}, {-7,-6,5,-5}, {3,6,5,6}, {-3,-1,8,1}, {-12,6,-10,8}, {-6,-23,8,-9},
+    {-10,3,4,9}, {2,3,9,10}, {4,-5,0,11}, {-3,-7,-10,-18}, {-5,9,7,-1}, {-6,6,-8,-5}, {7,-3,22,6}, {-14,9,2,0},
+    {0,8,3,22}, {-12,1,-12,2}, {13,-4,-3,-4}, {0,-6,-10,17}, {7,-23,-5,5}, {14,-1,7,8}, {1,15,-11,-5}, {0,12,-3,19},
+    {11,-7,7,1}, {4,-11,5,5}, {8,3,0,14}, {3,-6,-4,-15}, {2,-12,19,-2}, {7,15,-5,0}, {-16,17,6,10}, {-13,13,3,-1},
+    {10,4,4,-7}, {5,-7,-6,5}, {-14,-2,0,4}, {6,8,5,-10}, {3,-17,-6,2}, {5,1,-5,11}, {-3,2,14,1}, {6,12,21,3},
+    {-2,12,-4,-15}, {-5,-14,7,5}, {3,-10,-8,24}, {19,-20,17,-2}, {1,-7,2,-3}, {-4,22,-5,3}, {-1,-3,0,18}, {22,0,7,-18},
+    {5,10,0,24}, {-7,-4,15,-6}, {15,4,10,1}, {6,-11,-3,-22}, {-5,6,-7,-11}, {-8,-12,5,0}, {20,13,3,5}, {4,12,0,-19},
+    {2,-21,-3,2}, {-6,-1,-6,-5}, {8,10,13,-2}, {-19,-12,4,3}, {-1,-1,-7,3}, {-13,8,-18,-22}, {-13,14,4,-4}, {3,6,22,-2},
+    {7,-11,18,12}, {4,0,-20,4}, {-18,5,-4,5}, {4,3,19,-7}, {-7,10,-11,6}, {1,-1,9,18}, {-6,-5,-12,-1}, {4,-7,0,16},
+    {-8,-6,-1,12}, {17,-9,-2,8}, {-7,2,1,6}, {17,3,2,-8}, {-4,1,-14,13}, {-18,6,-7,3}, {2,15,19,-11}, {-20,17,-18,7},
+    {-8,-2,9,-4}, {-7,-4,17,-7}, {-14,-1,3,-2}, {0,22,-4,-15}, {8,-9,15,0}, {-8,-1,-7,-9}, {-2,7,6,8}, {-2,4,-1,6},
+    {-6,-3,2,1}, {-6,-6,-15,7}, {-6,2,6,10}, {2,-6,3,-20}, {5,-11,-9,-6}, {11,-4,0,8}, {-5,13,-8,11}, {5,-7,7,7},
+    {-8,10,-11,-2}, {-23,-14,-13,-19}, {19,0,5,-17}, {22,11,0,-3}, {-16,0,6,8}, {0,-7,-1,-1}, {7,-12,14,5}, {11,0,-3,2},
+    {-7,-13,-13,10}, {3,-6,10,-18}, {-3,-1,7,-10}, {-1,-5,15,2}, {4,7,8,-1}, {-12,1,-5,-5}, {1,-7,14,0}, {-11,6,-10,13},
+    {3,9,8,2}, {2,14,8,7}, {-2,-2,8,-10}, {3,-5,1,-5}, {1,-2,12,-7}, {-4,-13,7,1}, {-19,14,8,-14}, {1,-1,13,-10},
+    {-23,10,1,2}, {11,6,-5,0}, {-3,-6,-16,-5}, {1,5,10,10}, {-13,-9,-2,6}, {0,9,-14,-10}, {4,0,1,12}, {-9,1,-18,0},
+    {-23,-3,17,-2}, {-14,-12,-10,-3}, {-14,10,15,19}, {4,-8,0,-9}, {19,20,-9,2}, {10,13,-11,8}, {-4,-1,-13,-5}, {13,-5,-3,9},
+    {-13,-5,1,-17}, {8,13,1,-16}, {-7,-2,1,23}, {17,4,17,-11}, {2,-2,-5,4}, {-5,5,3,-13}, {19,-2,-4,2}, {-3,-11,6,-14},
+    {1,1,-2,-8}, {4,-1,6,2}, {2,-15,-2,12}, {-4,-16,6,3}, {5,0,5,2}, {-9,0,-7,-2}, {-5,-9,-2,-10}, {4,6,-8,-3},
+    {-1,-10,7,-18}, {-13,1,-7,2}, {-3,-8,0,5}, {6,12,2,5}, {-4,10,-9,4}, {2,-10,3,1}, {-8,8,-9,9}, {-2,12,-5,-2},
+    {-17,-13,-3,2}, {-19,-12,5,-11}, {-20,-8,-13,3}, {15,2,-10,-3}, {0,11,-4,-7}, {-5,-3,3,2}, {-23,-1,6,2}, {-1,8,-9,-10},
+    {-3,5,-7,-12}, {4,16,3,-14}, {-12,24,-7,-4}, {13,21,-11,6}, {3,10,7,-3}, {-4,11,0,-4}, {5,-1,-14,-6}, {7,4,-12,0},
+    {-7,-21,6,-14}, {-13,1,-6,0}, {-3,-10,8,3}, {7,-10,-1,14}, {2,-8,23,-11}, {22,-6,-11,5}, {-17,-9,13,-7}, {0,-4,7,-5},
+    {11,-19,-1,-18}, {-13,14,17,-3}, {-3,-9,-5,10}, {18,-3,-1,7}, {-10,6,-11,-2}, {-1,21,1,-5}, {10,7,-1,-4}, {18,19,-4,-6},
+    {-10,-16,-7,7}, {-1,11,3,11}, {-9,4,-15,-9}, {-3,0,-15,0}, {14,6,-3,-6}, {-4,-11,2,-8}, {0,-5,-2,-9}, {8,-2,-18,-23},
+    {-7,7,-19,-7}, {-10,0,8,11}, {6,12,-16,24}, {-16,-3,-2,2}, {-15,11,6,-6}, {13,-8,-15,-11}, {-5,-3,5,-23}, {-2,-10,-10,-2},
+    {19,0,9,3}, {11,-7,-8,-6}, {-8,12,9,6}, {7,0,1,17}, {21,1,8,7}, {3,2,-10,9}, {9,7,-7,-16}, {5,16,9,-3},
+    {-7,-5,5,-12}, {-15,-10,-15,-14}, {-10,-9,-14,-7}, {17,-4,-6,-7}, {4,12,0,-21}, {12,-2,-15,-6}, {0,8,-2,14}, {1,-7,-5,-11},
+    {1,12,4,-14}, {-4,17,13,-11}, {-4,19,-23,-4}, {4,-3,-1,5}, {-10,5,-15,6}, {-4,-21,-6,4}, {5,2,-6,-23}, {-4,0,15,-4},
+    {-6,0,2,-4}, {-14,-8,-3,9}, {12,16,8,7}, {18,15,11,-4}, {-19,9,9,-3}, {-8,-20,3,1}, {4,5,3,20}, {-11,-6,-20,10},
+    {6,2,-6,6}, {9,9,7,15}, {-1,-2,-7,2}, {-9,6,-12,-7}, {8,-6,5,2}, {9,12,-7,-23}, {8,-7,-6,18}, {1,-10,-1,2},
+    {-1,-11,-1,3}, {-1,3,-19,4}, {-11,2,7,9}, {-12,-1,-11,0}, {8,1,3,1}, {-2,-1,2,17}, {4,3,6,0}, {16,12,0,19},
+    {2,-4,6,-13}, {2,-7,9,-6}, {-13,-10,-7,-1}, {-3,-3,-18,-6}, {24,-14,-2,-10}, {3,7,-9,-8}, {-2,3,6,11}, {1,-10,-10,-4},
+    {12,-11,-8,-16}, {-6,-4,12,14}, {-5,-7,-3,-6}, {-19,0,-23,-5}, {4,-2,11,-9}, {-11,5,-6,-11}, {-4,2,9,13}, {4,-4,-2,3},
+    {2,3,11,7}, {11,-11,-12,2}, {-7,0,4,-8}, {3,-4,-2,-2}, {1,-1,-9,8}, {6,-1,-8,-2}, {-2,-1,-8,16}, {-21,15,-12,6},
+    {-15,9,8,17}, {8,4,-11,-3}, {9,0,1,16}, {0,8,5,1}, {-3,-1,8,-10}, {3,-7,-10,-5}, {3,-7,-5,0}, {-7,-4,-9,-6},
+    {-5,7,-18,-3}, {10,6,8,9}, {5,-7,7,-5}, {-6,4,-6,-10}, {-12,-13,-2,4}, {1,1,15,-8}, {-6,-11,-10,-3}, {0,2,-9,17},
+    {6,17,9,17}, {4,11,10,-4}, {4,9,7,-3}, {-14,-14,-4,-4}, {7,-21,-5,-13}, {-11,2,-16,0}, {-10,-13,-5,-3}, {-6,3,5,4},
+    {11,-7,-13,3}, {8,5,10,-2}, {10,0,4,-11}, {13,-8,0,-6}, {3,2,12,16}, {-13,5,10,-5}, {-6,-16,-6,8}, {-10,8,0,-11},
+    {7,-6,6,3}, {-11,-5,-8,-6}, {-13,6,-14,7}, {-3,8,12,-12}, {-3,15,8,-10}, {11,-6,7,6}, {-14,-2,-11,16}, {2,4,-7,-3},
+    {-2,-8,-10,4}, {3,-7,-10,0}, {4,-9,-6,-3}, {-14,8,-5,2}, {-5,1,4,-4}, {-17,10,2,8}, {9,16,10,13}, {-4,10,5,1},
+    {2,-1,4,11}, {9,-21,10,2}, {-8,1,-3,4}, {11,15,-6,5}, {14,0,-9,9}, {-4,17,-5,2}, {2,-8,8,-9}, {-8,5,-9,24},
+    {1,-4,-7,11}, {3,-1,8,-15}, {-12,-2,5,6}, {4,6,-10,6}, {11,10,0,-1}, {6,5,-13,7}, {-8,17,-14,-10}, {24,3,2,-2},
+    {3,-1,-5,-17}, {-13,-1,-16,2}, {2,0,-9,2}, {7,-8,-20,-18}, {-2,-11,-1,12}, {-3,-2,-1,4}, {6,-12,10,1}, {1,11,5,0},
+    {-6,7,-2,11}, {6,7,-10,12}, {13,-10,-6,6}, {-2,-7,-6,0}, {6,22,-3,-23}, {2,-8,2,6}, {-13,-12,6,15}, {15,8,3,-14},
+    {-21,-10,10,8}, {6,12,13,-11}, {0,8,-3,23}, {2,-2,-7,6}, {12,-5,7,-13}, {-2,-8,7,12}, {-4,-1,-11,-14}, {0,-22,-2,-17},
+    {0,-5,-8,6}, {11,-23,21,-5}, {8,-9,7,-1}, {5,0,-11,-1}, {-5,-11,8,-11}, {-21,-10,12,-11}, {7,-6,-5,-12}, {-3,0,7,15},
+    {0,15,-3,-16}, {-4,-13,4,7}, {2,12,13,-12}, {4,5,13,11}, {-6,12,-11,3}, {-5,-20,-12,9}, {-7,5,3,-2}, {-6,8,8,12},
+    {11,-4,0,-6}, {14,0,-2,-5}, {19,-13,-11,15}, {5,3,14,-7}, {9,-19,2,5}, {-13,3,23,10}, {4,-14,16,-11}, {-3,2,-2,14},
+    {13,4,14,-6}, {1,3,4,-10}, {2,-17,-7,-3}, {0,-13,23,-6}, {-13,-10,7,-12}, {1,3,-10,-8}, {-11,-15,-7,-17}, {-2,5,-13,-8},
+    {-1,7,2,-2}, {2,-1,-4,11}, {-11,1,-1,-11}, {7,5,-4,-7}, {9,-10,19,0}, {7,-1,5,7}, {9,-8,10,-5}, {-19,-2,-1,5},
+    {11,4,0,-3}, {-8,2,-6,15}, {-4,-2,-1,9}, {0,-16,24,-5}, {-3,-6,-1,-4}, {-16,-2,7,-6}, {-4,-18,8,-18}, {1,-20,-9,-6},
+    {-16,3,-7,-14}, {-2,-1,4,-23}, {-2,13,-15,4}, {17,-5,11,-10}, {15,-9,-3,-15}, {24,15,-8,-1}, {-7,-9,12,-6}, {7,6,2,-10},
+    {8,-5,-15,2}, {-1,-8,19,10}, {5,4,13,-6}, {-9,17,-3,0}, {12,9,9,-14}, {-1,4,1,8}, {-5,3,-2,-1}, {-3,-5,-10,-9},
+    {3,-7,1,-6}, {8,-2,-9,-2}, {-2,18,-5,17}, {5,-1,-8,-4}, {8,-4,-7,16}, {8,-2,14,4}, {12,0,24,4}, {-12,-9,-4,-5},
+    {-5,-11,-22,-4}, {12,-6,-2,3}, {-8,8,24,8}, {-7,-21,12,-19}, {-4,-1,-1,0}, {-3,-13,3,9}, {-8,-10,14,1}, {-5,-22,-5,-2},
+    {14,6,-12,3}, {4,4,2,-7}, {-7,17,1,-6}, {24,-6,-3,-11}, {1,12,17,21}, {-10,23,-9,18}, {-16,24,7,-9}, {-3,5,-4,4},
+    {4,-2,-4,7}, {6,-9,-9,12}, {-3,-1,6,6}, {15,-5,1,14}, {7,0,-23,1}, {5,2,6,-3}, {-10,5,7,12}, {-6,0,-16,13},
+    {12,4,6,10}, {7,5,-1,-5}, {5,11,0,-13}, {5,-14,6,11}, {16,0,-3,3}, {2,-12,-6,-3}, {-13,0,6,-10}, {-4,-5,4,4},
+    {-15,14,10,-10}, {-8,-6,0,9}, {9,-14,-23,3}, {-1,3,-1,2}, {2,8,12,24}, {11,-14,-13,0}, {4,10,-14,5}, {-10,4,-1,-11},
+    {1,2,-9,-12}, {-20,2,1,6}, {-5,-1,-9,4}, {9,0,22,-4}, {-11,-6,-4,-18}, {1,0,1,8}, {11,5,-3,-15}, {-10,-6,-7,-5},
+    {-5,13,-8,2}, {-7,-7,1,-23}, {9,22,-15,15}, {11,9,8,1}, {-8,-12,7,-3}, {17,-4,-8,-1}, {19,4,4,11}, {5,15,4,-6},
+    {-12,-2,3,-19}, {-12,-16,15,6}, {-6,-1,14,-2}, {-17,-13,-3,2}, {-2,-5,6,0}, {-20,7,-10,-23}, {3,-18,14,-5}, {3,-5,11,-11}
+};
+
+// Rotate a pattern point by the keypoint angle like OpenCV : float rotation truncated towards zero, clamped to the patch
+static inline void rotateBriefPoint(int &y, int &x, float s, float c)
+{
+    int rx = (int)((float)x * c - (float)y * s);
+    int ry = (int)((float)x * s + (float)y * c);
+    x = max(-briefPatchRadius, min(briefPatchRadius, rx));
+    y = max(-briefPatchRadius, min(briefPatchRadius, ry));
+}
+
+// Sampling pattern of one descriptor length as element offsets into the box sum plane (row step in elements), rotated by
+// the keypoint angle (degrees) with useOrientation
+static void getBriefPattern(int bytes, int step, bool useOrientation, float angle, int *offA, int *offB)
+{
+    float s = 0, c = 1;
+    if (useOrientation)
+    {
+        angle *= (float)(CV_PI / 180.f);
+        s = (float)std::sin(angle);
+        c = (float)std::cos(angle);
+    }
+    for (int k = 0; k < 8 * bytes; ++k)
+    {
+        int ya = briefPairs[k][0], xa = briefPairs[k][1], yb = briefPairs[k][2], xb = briefPairs[k][3];
+        if (useOrientation)
+        {
+            rotateBriefPoint(ya, xa, s, c);
+            rotateBriefPoint(yb, xb, s, c);
+        }
+        offA[k] = ya * step + xa;
+        offB[k] = yb * step + xb;
+    }
+}
+
+// Descriptor blocks reused across frames : a block is handed out again once no frame refers to it any more (the arena
+// holds the only reference), so descriptors of frames still in the ring buffer are never overwritten. Blocks come from the
+// OpenCV allocator (64 byte aligned) and only grow when a frame has more keypoints than a free block holds.
+static cv::Mat getBriefArena(int rows, int bytes)
+{
+    static vector<cv::Mat> blocks;
+    static cv::Mutex blocksMutex;
+    cv::AutoLock lock(blocksMutex);
+
+    for (auto it = blocks.begin(); it != blocks.end(); ++it)
+    {
+        if (it->cols != bytes || it->u->refcount != 1)
+            continue;
+        if (it->rows < rows)
+            *it = cv::Mat(rows, bytes, CV_8U);
+        return it->rowRange(0, rows);
+    }
+    blocks.push_back(cv::Mat(max(rows, briefArenaRows), bytes, CV_8U));
+    return blocks.back().rowRange(0, rows);
+}
+
+// Bit j of descriptor byte i compares the box sums of pair 8 * i + j (set if the sum at A is smaller than at B)
+static void briefRowScalar(const int *center, const int *offA, const int *offB, int bytes, uchar *desc)
+{
+    for (int i = 0; i < bytes; ++i)
+    {
+        uchar byte = 0;
+        for (int j = 0; j < 8; ++j)
+            byte |= (uchar)((center[offA[8 * i + j]] < center[offB[8 * i + j]]) << j);
+        desc[i] = byte;
+    }
+}
+
+#ifdef BRIEF_X86_SIMD
+// AVX2 : one descriptor byte per iteration, the 8 pairs are fetched with two gathers and the comparison mask is packed
+// into the byte with movemask (lane j -> bit j, same layout as the scalar path)
+__attribute__((target("avx2"))) static void briefRowAVX2(const int *center, const int *offA, const int *offB, int bytes, uchar *desc)
+{
+    for (int i = 0; i < bytes; ++i)
+    {
+        __m256i idxA = _mm256_loadu_si256((const __m256i *)(offA + 8 * i));
+        __m256i idxB = _mm256_loadu_si256((const __m256i *)(offB + 8 * i));
+        __m256i sumA = _mm256_i32gather_epi32(center, idxA, 4);
+        __m256i sumB = _mm256_i32gather_epi32(center, idxB, 4);
+        __m256i less = _mm256_cmpgt_epi32(sumB, sumA);
+        desc[i] = (uchar)_mm256_movemask_ps(_mm256_castsi256_ps(less));
+    }
+}
+#endif
+
+// Returns true if the SIMD gather path is available on this CPU
+bool briefUsesSIMD()
+{
+#ifdef BRIEF_X86_SIMD
+    static bool hasAVX2 = __builtin_cpu_supports("avx2");
+    return hasAVX2;
+#else
+    return false;
+#endif
+}
+
+// In-tree BRIEF descriptor (16, 32 or 64 bytes) computed on the cached 9x9 box sums of the frame planes with the sampling
+// pattern of OpenCV, so the rows are bit for bit those of cv::xfeatures2d::BriefDescriptorExtractor (with useOrientation the
+// pattern is rotated by the keypoint angle). Keypoints too close to the border are removed, the remaining rows are written
+// into a reused descriptor block (one row per keypoint).
+void describeBRIEF(std::vector<cv::KeyPoint> &keypoints, ImagePlanes &planes, cv::Mat &descriptors, int bytes, bool useOrientation,
+                   bool bUseSIMD)
+{
+    if (bytes != 16 && bytes != 32 && bytes != 64)
+        CV_Error(cv::Error::StsBadArg, "BRIEF descriptor length must be 16, 32 or 64 bytes");
+
+    const cv::Mat &boxSum = getBoxSumImage(planes);
+    cv::KeyPointsFilter::runByImageBorder(keypoints, boxSum.size(), briefBorder);
+
+    // pattern points as element offsets into the box sum plane, rotated per keypoint with useOrientation
+    int nBits = 8 * bytes;
+    int step = (int)boxSum.step1();
+    vector<int> offA(nBits), offB(nBits);
+    if (!useOrientation)
+        getBriefPattern(bytes, step, false, 0, offA.data(), offB.data());
+
+    void (*briefRow)(const int *, const int *, const int *, int, uchar *) = briefRowScalar;
+#ifdef BRIEF_X86_SIMD
+    if (bUseSIMD && briefUsesSIMD())
+        briefRow = briefRowAVX2;
+#endif
+
+    descriptors.release(); // frees the block of the previous call unless a frame still holds it
+    if (keypoints.empty())
+    {
+        descriptors.create(0, bytes, CV_8U);
+        return;
+    }
+    descriptors = getBriefArena((int)keypoints.size(), bytes);
+    for (size_t i = 0; i < keypoints.size(); ++i)
+    {
+        const cv::KeyPoint &kpt = keypoints[i];
+        if (useOrientation)
+            getBriefPattern(bytes, step, true, kpt.angle, offA.data(), offB.data());
+        const int *center = boxSum.ptr<int>((int)(kpt.pt.y + 0.5f)) + (int)(kpt.pt.x + 0.5f);
+        briefRow(center, offA.data(), offB.data(), bytes, descriptors.ptr<uchar>((int)i));
+    }
+}
+
+// Compare the in-tree BRIEF with cv::xfeatures2d::BriefDescriptorExtractor on FAST keypoints of all frames. Both extractors
+// must keep the same keypoints and the SIMD and scalar rows must match the OpenCV rows bit for bit (asserted).
+void benchmarkBRIEF(std::vector<cv::Mat> &images)
+{
+    int byteOptions[] = {16, 32, 64};
+    cout << "============================================="<<endl;
+    cout << "BRIEF benchmark (in-tree " << (briefUsesSIMD() ? "AVX2" : "scalar") << " / in-tree scalar / OpenCV)" << endl;
+    for (int o = 0; o < 2; ++o)
+    {
+        bool useOrientation = o == 1;
+        for (int b = 0; b < 3; ++b)
+        {
+            int bytes = byteOptions[b];
+            cv::Ptr<cv::DescriptorExtractor> reference = cv::xfeatures2d::BriefDescriptorExtractor::create(bytes, useOrientation);
+            double tSIMD = 0, tScalar = 0, tRef = 0;
+            int nKpts = 0, nRowMismatch = 0, nKptMismatch = 0;
+            for (size_t i = 0; i < images.size(); ++i)
+            {
+                ImagePlanes planes;
+                initImagePlanes(planes, images[i]);
+                vector<cv::KeyPoint> keypoints;
+                getDetector("FAST")->detect(planes.gray, keypoints);
+                getBoxSumImage(planes); // box sums are cached per frame, keep them out of the timing
+                vector<cv::KeyPoint> kptsSIMD = keypoints, kptsScalar = keypoints, kptsRef = keypoints;
+                cv::Mat descSIMD, descScalar, descRef;
+
+                double t = (double)cv::getTickCount();
+                describeBRIEF(kptsSIMD, planes, descSIMD, bytes, useOrientation, true);
+                tSIMD += ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+                t = (double)cv::getTickCount();
+                describeBRIEF(kptsScalar, planes, descScalar, bytes, useOrientation, false);
+                tScalar += ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+                t = (double)cv::getTickCount();
+                reference->compute(planes.gray, kptsRef, descRef);
+                tRef += ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+                nKpts += kptsSIMD.size();
+                if (kptsRef.size() != kptsSIMD.size())
+                {
+                    nKptMismatch += abs((int)kptsRef.size() - (int)kptsSIMD.size());
+                    continue;
+                }
+                for (size_t k = 0; k < kptsRef.size(); ++k)
+                {
+                    nKptMismatch += kptsRef[k].pt != kptsSIMD[k].pt;
+                    nRowMismatch += cv::norm(descSIMD.row((int)k), descRef.row((int)k), cv::NORM_HAMMING) > 0 ||
+                                    cv::norm(descScalar.row((int)k), descRef.row((int)k), cv::NORM_HAMMING) > 0;
+                }
+            }
+            double n = max<size_t>(1, images.size());
+            cout << bytes << " bytes" << (useOrientation ? ", oriented" : "") << " : n=" << nKpts << ", in-tree avg " << 1000 * tSIMD / n
+                 << " ms, scalar avg " << 1000 * tScalar / n << " ms, OpenCV avg " << 1000 * tRef / n << " ms, row mismatches with OpenCV "
+                 << nRowMismatch << ", keypoint mismatches " << nKptMismatch << endl;
+            CV_Assert(nRowMismatch == 0 && nKptMismatch == 0);
+        }
+    }
+    cout << "============================================="<<endl;
+}
@@ -0,0 +1,16 @@
+
+#ifndef briefDescriptor_hpp
+#define briefDescriptor_hpp
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "dataStructures.h"
+
+
+void describeBRIEF(std::vector<cv::KeyPoint> &keypoints, ImagePlanes &planes, cv::Mat &descriptors, int bytes, bool useOrientation,
+                   bool bUseSIMD=true);
+bool briefUsesSIMD();
+void benchmarkBRIEF(std::vector<cv::Mat> &images);
+
+#endif /* briefDescriptor_hpp */
@@ -1,5 +1,7 @@
 
 #include <iostream>
+#include <iomanip>
+#include <cmath>
 #include <algorithm>
 #include <numeric>
 #include <opencv2/highgui/highgui.hpp>
@@ -61,6 +63,19 @@ void clusterLidarWithROI(std::vector<BoundingBox> &boundingBoxes, std::vector<Li
     } // eof loop over all Lidar points
 }
 
+// Create a binary mask (CV_8UC1, 255 inside) covering all bounding boxes, each box is enlarged by dilatePx on every side
+cv::Mat createROIMask(std::vector<BoundingBox> &boundingBoxes, cv::Size imageSize, int dilatePx)
+{
+    cv::Mat mask = cv::Mat::zeros(imageSize, CV_8UC1);
+    cv::Rect imageRect(cv::Point(0, 0), imageSize);
+    for (auto it = boundingBoxes.begin(); it != boundingBoxes.end(); ++it)
+    {
+        cv::Rect dilatedBox(it->roi.x - dilatePx, it->roi.y - dilatePx, it->roi.width + 2 * dilatePx, it->roi.height + 2 * dilatePx);
+        mask(dilatedBox & imageRect).setTo(255);
+    }
+    return mask;
+}
+
 /* 
 * The show3DObjects() function below can handle different output image sizes, but the text output has been manually tuned to fit the 2000x2000 size. 
 * However, you can make this function work for other sizes too.
@@ -382,3 +397,43 @@ void matchBoundingBoxes(std::vector<cv::DMatch> &matches, std::map<int, int> &bb
         boundingBoxPairs.clear();
     }
 }
+
+// Print matching time versus camera TTC stability per detector / descriptor run : mean frame-to-frame change of the camera
+// TTC, mean deviation from the lidar TTC and the no. of invalid camera TTCs (not finite or not positive)
+void printTTCStability(const std::vector<TTCresult> &results)
+{
+    cout << "=============================================" << endl;
+    cout << left << setw(10) << "detector" << setw(12) << "descriptor" << setw(20) << "length" << right << setw(14) << "match [ms]"
+         << setw(14) << "|dTTC| [s]" << setw(16) << "|cam-lidar| [s]" << setw(10) << "invalid" << endl;
+    cout << fixed << setprecision(2);
+    for (auto it = results.begin(); it != results.end(); ++it)
+    {
+        double sumStep = 0, sumDeviation = 0;
+        int nStep = 0, nDeviation = 0, nInvalid = 0;
+        for (size_t i = 0; i < it->cameraBasedTTC.size(); ++i)
+        {
+            double ttc = it->cameraBasedTTC[i];
+            if (!std::isfinite(ttc) || ttc <= 0)
+            {
+                nInvalid++;
+                continue;
+            }
+            if (i > 0 && std::isfinite(it->cameraBasedTTC[i - 1]) && it->cameraBasedTTC[i - 1] > 0)
+            {
+                sumStep += fabs(ttc - it->cameraBasedTTC[i - 1]);
+                nStep++;
+            }
+            if (i < it->lidarBasedTTC.size() && std::isfinite(it->lidarBasedTTC[i]))
+            {
+                sumDeviation += fabs(ttc - it->lidarBasedTTC[i]);
+                nDeviation++;
+            }
+        }
+        cout << left << setw(10) << it->detectorType << setw(12) << it->descriptorType << setw(20) << it->descriptorLength << right
+             << setw(14) << it->matchingTime / max(1, it->nMatchedFrames) << setw(14) << (nStep > 0 ? sumStep / nStep : 0.0)
+             << setw(16) << (nDeviation > 0 ? sumDeviation / nDeviation : 0.0) << setw(10) << nInvalid << endl;
+    }
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6);
+    cout << "=============================================" << endl;
+}
@@ -25,9 +25,17 @@ struct BoundingBox { // bounding box around a classified object (contains both 2
     std::vector<cv::DMatch> kptMatches; // keypoint matches enclosed by 2D roi
 };
 
+struct ImagePlanes { // preprocessed planes of a camera image, computed once per frame and shared by detection and description
+    cv::Mat gray;                 // grayscale image (computed when the planes are initialized)
+    cv::Mat integral;             // integral image of the grayscale image (built on demand)
+    cv::Mat boxSum;               // 9x9 box sums (CV_32S) of the grayscale image for BRIEF (built on demand)
+    std::vector<cv::Mat> flowPyramid; // Lucas-Kanade pyramid with derivatives for KLT tracking (built on demand)
+};
+
 struct DataFrame { // represents the available sensor information at the same time instance
     
     cv::Mat cameraImg; // camera image
+    ImagePlanes planes; // grayscale image, integral image and KLT pyramid shared by all processing stages
     
     std::vector<cv::KeyPoint> keypoints; // 2D keypoints within camera image
     cv::Mat descriptors; // keypoint descriptors
@@ -36,11 +44,15 @@ struct DataFrame { // represents the available sensor information at the same ti
 
     std::vector<BoundingBox> boundingBoxes; // ROI around detected objects in 2D image coordinates
     std::map<int,int> bbMatches; // bounding box matches between previous and current frame
+    std::map<int,cv::Point2f> boxFlow; // median keypoint motion from the previous frame per bounding box (px)
 };
 
 struct TTCresult { // TTC result of lidar and camera based on detector & descriptor type
     std::string detectorType;
     std::string descriptorType;
+    std::string descriptorLength; // length setting of the descriptor (e.g. "16 bytes", "32 bytes WTA_K 3")
+    double matchingTime;          // sum of the descriptor matching time of all frames [ms]
+    int nMatchedFrames;           // no. of frames that were matched to their predecessor
     std::vector<double> lidarBasedTTC;
     std::vector<double> cameraBasedTTC;
 };
@@ -0,0 +1,239 @@
+
+#include <cmath>
+#include <queue>
+#include <algorithm>
+#include <functional>
+
+#include "hnswIndex.hpp"
+
+using namespace std;
+
+typedef pair<float, int> DistId; // squared L2 distance and node id
+
+static inline float nodeDistance(const HnswIndex &index, const float *query, int node)
+{
+    return cv::normL2Sqr<float, float>(query, &index.data[(size_t)node * index.dim], index.dim);
+}
+
+// Greedy walk on an upper layer : move to the closest neighbour until no neighbour is closer
+static DistId greedyClosest(const HnswIndex &index, const float *query, DistId entry, int layer)
+{
+    bool bChanged = true;
+    while (bChanged)
+    {
+        bChanged = false;
+        const vector<int> &neighbours = index.links[entry.second][layer];
+        for (auto it = neighbours.begin(); it != neighbours.end(); ++it)
+        {
+            float d = nodeDistance(index, query, *it);
+            if (d < entry.first)
+            {
+                entry = DistId(d, *it);
+                bChanged = true;
+            }
+        }
+    }
+    return entry;
+}
+
+// Best-first search on one layer from the entry nodes, returns the ef closest nodes found sorted by distance. visited holds
+// the stamp of the last search that reached a node, so it is cleared only once per index / thread.
+static void searchLayer(const HnswIndex &index, const float *query, const vector<DistId> &entries, int ef, int layer,
+                        vector<int> &visited, int stamp, vector<DistId> &result)
+{
+    priority_queue<DistId, vector<DistId>, greater<DistId>> candidates; // closest first
+    priority_queue<DistId> nearest;                                     // farthest first, at most ef entries
+    for (auto it = entries.begin(); it != entries.end(); ++it)
+    {
+        if (visited[it->second] == stamp)
+            continue;
+        visited[it->second] = stamp;
+        candidates.push(*it);
+        nearest.push(*it);
+        if ((int)nearest.size() > ef)
+            nearest.pop();
+    }
+
+    while (!candidates.empty())
+    {
+        DistId current = candidates.top();
+        if (current.first > nearest.top().first)
+            break; // all remaining candidates are farther than the worst result
+        candidates.pop();
+
+        const vector<int> &neighbours = index.links[current.second][layer];
+        for (auto it = neighbours.begin(); it != neighbours.end(); ++it)
+        {
+            if (visited[*it] == stamp)
+                continue;
+            visited[*it] = stamp;
+            float d = nodeDistance(index, query, *it);
+            if ((int)nearest.size() < ef || d < nearest.top().first)
+            {
+                candidates.push(DistId(d, *it));
+                nearest.push(DistId(d, *it));
+                if ((int)nearest.size() > ef)
+                    nearest.pop();
+            }
+        }
+    }
+
+    result.resize(nearest.size());
+    for (int i = (int)nearest.size() - 1; i >= 0; --i)
+    {
+        result[i] = nearest.top();
+        nearest.pop();
+    }
+}
+
+// Neighbour selection heuristic of HNSW : a candidate (sorted by distance) is linked only if it is closer to the new node
+// than to every node selected so far, which keeps links spread in all directions. Free slots are filled with the closest
+// pruned candidates.
+static void selectNeighbours(const HnswIndex &index, const vector<DistId> &candidates, int m, vector<int> &selected)
+{
+    selected.clear();
+    vector<int> pruned;
+    for (auto it = candidates.begin(); it != candidates.end() && (int)selected.size() < m; ++it)
+    {
+        const float *candidate = &index.data[(size_t)it->second * index.dim];
+        bool bDiverse = true;
+        for (auto s = selected.begin(); s != selected.end() && bDiverse; ++s)
+            bDiverse = nodeDistance(index, candidate, *s) >= it->first;
+        if (bDiverse)
+            selected.push_back(it->second);
+        else
+            pruned.push_back(it->second);
+    }
+    for (auto it = pruned.begin(); it != pruned.end() && (int)selected.size() < m; ++it)
+        selected.push_back(*it);
+}
+
+// Create an empty index for descriptors of length dim, the random layer assignment uses a fixed seed
+void initHnswIndex(HnswIndex &index, int dim, int M, int efConstruction, int efSearch)
+{
+    if (dim < 1 || M < 2 || efConstruction < 1 || efSearch < 1)
+        CV_Error(cv::Error::StsBadArg, "invalid HNSW parameters");
+    index.dim = dim;
+    index.M = M;
+    index.efConstruction = efConstruction;
+    index.efSearch = efSearch;
+    index.data.clear();
+    index.links.clear();
+    index.entryPoint = -1;
+    index.maxLevel = -1;
+    index.rng = cv::RNG(0x48535700);
+}
+
+// Insert descriptors (CV_32F rows) into the graph one by one, the index can be extended at any time
+void addToHnswIndex(HnswIndex &index, const cv::Mat &descriptors)
+{
+    if (descriptors.empty())
+        return;
+    if (descriptors.type() != CV_32F || descriptors.cols != index.dim)
+        CV_Error(cv::Error::StsBadArg, "HNSW index needs float descriptors of the configured length");
+
+    double levelFactor = 1.0 / std::log((double)index.M);
+    vector<int> visited(index.links.size() + descriptors.rows, -1);
+    int stamp = 0;
+    index.data.reserve(index.data.size() + (size_t)descriptors.rows * index.dim);
+    for (int r = 0; r < descriptors.rows; ++r)
+    {
+        int node = (int)index.links.size();
+        const float *row = descriptors.ptr<float>(r);
+        index.data.insert(index.data.end(), row, row + index.dim);
+        const float *query = &index.data[(size_t)node * index.dim];
+
+        int level = (int)std::floor(-std::log(std::max(index.rng.uniform(0.0, 1.0), 1e-12)) * levelFactor);
+        index.links.push_back(vector<vector<int>>(level + 1));
+        if (index.entryPoint < 0)
+        {
+            index.entryPoint = node;
+            index.maxLevel = level;
+            continue;
+        }
+
+        // descend to the layer of the new node, then link it on every layer from there down to layer 0
+        DistId entry(nodeDistance(index, query, index.entryPoint), index.entryPoint);
+        for (int layer = index.maxLevel; layer > level; --layer)
+            entry = greedyClosest(index, query, entry, layer);
+
+        vector<DistId> entries(1, entry), found, candidates;
+        vector<int> selected, shrunk;
+        for (int layer = min(level, index.maxLevel); layer >= 0; --layer)
+        {
+            searchLayer(index, query, entries, index.efConstruction, layer, visited, stamp++, found);
+            selectNeighbours(index, found, index.M, selected);
+            index.links[node][layer] = selected;
+
+            int maxLinks = layer == 0 ? 2 * index.M : index.M;
+            for (auto it = selected.begin(); it != selected.end(); ++it)
+            {
+                vector<int> &neighbourLinks = index.links[*it][layer];
+                neighbourLinks.push_back(node);
+                if ((int)neighbourLinks.size() <= maxLinks)
+                    continue;
+
+                // too many links, keep a diverse subset
+                const float *neighbour = &index.data[(size_t)(*it) * index.dim];
+                candidates.clear();
+                for (auto l = neighbourLinks.begin(); l != neighbourLinks.end(); ++l)
+                    candidates.push_back(DistId(nodeDistance(index, neighbour, *l), *l));
+                std::sort(candidates.begin(), candidates.end());
+                selectNeighbours(index, candidates, maxLinks, shrunk);
+                neighbourLinks = shrunk;
+            }
+            entries = found;
+        }
+
+        if (level > index.maxLevel)
+        {
+            index.maxLevel = level;
+            index.entryPoint = node;
+        }
+    }
+}
+
+// k approximate nearest neighbours of a query (squared L2 distance, node id), sorted by distance
+static void searchKnn(const HnswIndex &index, const float *query, int k, vector<DistId> &neighbours, vector<int> &visited, int stamp)
+{
+    neighbours.clear();
+    if (index.entryPoint < 0)
+        return;
+    DistId entry(nodeDistance(index, query, index.entryPoint), index.entryPoint);
+    for (int layer = index.maxLevel; layer > 0; --layer)
+        entry = greedyClosest(index, query, entry, layer);
+    searchLayer(index, query, vector<DistId>(1, entry), max(index.efSearch, k), 0, visited, stamp, neighbours);
+    if ((int)neighbours.size() > k)
+        neighbours.resize(k);
+}
+
+// Approximate kNN-2 matching of all query rows (CV_32F) against the index with the ratio test on L2 distances (ratio <= 0
+// keeps the nearest neighbour). Queries run in parallel, matches use queryIdx = query row and trainIdx = node id.
+void matchHnswKnn2(const HnswIndex &index, const cv::Mat &query, std::vector<cv::DMatch> &matches, float ratio)
+{
+    matches.clear();
+    if (query.empty() || index.entryPoint < 0)
+        return;
+    if (query.type() != CV_32F || query.cols != index.dim)
+        CV_Error(cv::Error::StsBadArg, "HNSW query needs float descriptors of the indexed length");
+
+    vector<cv::DMatch> queryMatches(query.rows);
+    vector<uchar> accepted(query.rows, 0);
+    cv::parallel_for_(cv::Range(0, query.rows), [&](const cv::Range &range) {
+        vector<int> visited(index.links.size(), -1);
+        vector<DistId> neighbours;
+        for (int q = range.start; q < range.end; ++q)
+        {
+            searchKnn(index, query.ptr<float>(q), 2, neighbours, visited, q);
+            if (neighbours.empty())
+                continue;
+            float d1 = std::sqrt(neighbours[0].first);
+            accepted[q] = ratio <= 0 || neighbours.size() < 2 || d1 < ratio * std::sqrt(neighbours[1].first);
+            queryMatches[q] = cv::DMatch(q, neighbours[0].second, d1);
+        }
+    });
+
+    for (int q = 0; q < query.rows; ++q)
+        if (accepted[q])
+            matches.push_back(queryMatches[q]);
+}
@@ -0,0 +1,25 @@
+
+#ifndef hnswIndex_hpp
+#define hnswIndex_hpp
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+
+struct HnswIndex { // hierarchical navigable small world graph over float descriptors (L2 distance)
+    int dim;                                           // descriptor length (128 for SIFT)
+    int M;                                             // max. links per node on the upper layers (2 * M on layer 0)
+    int efConstruction;                                // candidate list size while inserting
+    int efSearch;                                      // candidate list size while searching (>= k)
+    std::vector<float> data;                           // descriptors of all nodes, node i at data[i * dim]
+    std::vector<std::vector<std::vector<int>>> links;  // links[node][layer] : neighbour node ids
+    int entryPoint;                                    // node on the top layer where every search starts (-1 : empty)
+    int maxLevel;                                      // top layer of the graph
+    cv::RNG rng;                                       // draws the layer of new nodes
+};
+
+void initHnswIndex(HnswIndex &index, int dim, int M, int efConstruction, int efSearch);
+void addToHnswIndex(HnswIndex &index, const cv::Mat &descriptors);
+void matchHnswKnn2(const HnswIndex &index, const cv::Mat &query, std::vector<cv::DMatch> &matches, float ratio);
+
+#endif /* hnswIndex_hpp */
@@ -147,3 +147,50 @@ void showLidarImgOverlay(cv::Mat &img, std::vector<LidarPoint> &lidarPoints, cv:
         extVisImg = &visImg;
     }
 }
+
+// Compute the image region covered by the given Lidar points. The 3D extent of the points is expanded to an object envelope
+// (height range minZ..maxZ and lateral margin marginY in [m]) before projecting its corners into the camera, so that the
+// returned ROI encloses the whole vehicle and not only the part hit by the cropped Lidar points.
+// Returns an empty rect if no point lies in front of the camera.
+cv::Rect computeLidarImageROI(std::vector<LidarPoint> &lidarPoints, cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT, cv::Size imageSize,
+                              float minZ, float maxZ, float marginY, int marginPx)
+{
+    // find 3D extent of the Lidar points
+    double minXw = 1e9, maxXw = -1e9, minYw = 1e9, maxYw = -1e9;
+    for (auto it = lidarPoints.begin(); it != lidarPoints.end(); ++it)
+    {
+        minXw = minXw < it->x ? minXw : it->x;
+        maxXw = maxXw > it->x ? maxXw : it->x;
+        minYw = minYw < it->y ? minYw : it->y;
+        maxYw = maxYw > it->y ? maxYw : it->y;
+    }
+    if (lidarPoints.empty() || minXw <= 0.0)
+    {
+        return cv::Rect();
+    }
+
+    // project all corners of the expanded 3D envelope into the image
+    cv::Mat P = P_rect_xx * R_rect_xx * RT;
+    cv::Mat X(4, 1, cv::DataType<double>::type);
+    cv::Mat Y(3, 1, cv::DataType<double>::type);
+    double xs[2] = {minXw, maxXw}, ys[2] = {minYw - marginY, maxYw + marginY}, zs[2] = {minZ, maxZ};
+    double left = 1e9, top = 1e9, right = -1e9, bottom = -1e9;
+    for (int i = 0; i < 8; ++i)
+    {
+        X.at<double>(0, 0) = xs[i & 1];
+        X.at<double>(1, 0) = ys[(i >> 1) & 1];
+        X.at<double>(2, 0) = zs[(i >> 2) & 1];
+        X.at<double>(3, 0) = 1;
+
+        Y = P * X;
+        double u = Y.at<double>(0, 0) / Y.at<double>(2, 0);
+        double v = Y.at<double>(1, 0) / Y.at<double>(2, 0);
+        left = min(left, u); right = max(right, u);
+        top = min(top, v); bottom = max(bottom, v);
+    }
+
+    // add pixel margin and clip to image
+    cv::Rect roi(cv::Point((int)floor(left) - marginPx, (int)floor(top) - marginPx),
+                 cv::Point((int)ceil(right) + marginPx, (int)ceil(bottom) + marginPx));
+    return roi & cv::Rect(cv::Point(0, 0), imageSize);
+}
@@ -13,4 +13,6 @@ void loadLidarFromFile(std::vector<LidarPoint> &lidarPoints, std::string filenam
 
 void showLidarTopview(std::vector<LidarPoint> &lidarPoints, cv::Size worldSize, cv::Size imageSize, bool bWait=true);
 void showLidarImgOverlay(cv::Mat &img, std::vector<LidarPoint> &lidarPoints, cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT, cv::Mat *extVisImg=nullptr);
+cv::Rect computeLidarImageROI(std::vector<LidarPoint> &lidarPoints, cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT, cv::Size imageSize,
+                              float minZ, float maxZ, float marginY, int marginPx);
 #endif /* lidarData_hpp */
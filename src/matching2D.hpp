@@ -9,27 +9,120 @@
 #include <vector>
 #include <cmath>
 #include <limits>
+#include <map>
 
 #include <opencv2/core.hpp>
+#include <opencv2/core/hal/hal.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/features2d.hpp>
+#include <opencv2/video/tracking.hpp>
 #include <opencv2/xfeatures2d.hpp>
 #include <opencv2/xfeatures2d/nonfree.hpp>
 
 #include "dataStructures.h"
+#include "matchingKernels.hpp"
+#include "hnswIndex.hpp"
 
 
-void detKeypointsHarris(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis=false);
-void detKeypointsORB(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis=false);
-void detKeypointsAKAZE(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis=false);
-void detKeypointsSIFT(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis=false);
-void detKeypointsBRISK(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis=false);
-void detKeypointsFAST(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis=false);
-void detKeypointsShiTomasi(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis=false);
+struct ThresholdController { // closed-loop control of a detector threshold towards a target no. of keypoints per frame
+    double threshold;                  // threshold used for the next frame
+    double minThreshold, maxThreshold; // range of the threshold
+    int targetCount;                   // desired no. of keypoints per frame
+    double gain;                       // exponent of the multiplicative update (0 .. 1)
+    double maxStep;                    // max. relative change per frame (> 1), bounds the overshoot
+    int lastCount;                     // no. of keypoints of the last frame
+};
 
-void detKeypointsModern(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, std::string detectorType, bool bVis=false);
-void descKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, std::string descriptorType);
+struct DescriptorLengthConfig { // length of the configurable descriptors, shorter descriptors cut the matcher bandwidth
+    int briefBytes;        // BRIEF / BRIEF_SIMD length in bytes (16, 32, 64)
+    bool briefOrientation; // rotate the BRIEF pattern by the keypoint angle
+    int akazeBits;         // AKAZE descriptor_size in bits (0 : full length of 486 bits)
+    int orbWtaK;           // ORB WTA_K (2 : NORM_HAMMING, 3 or 4 : NORM_HAMMING2)
+    int freakBytes;        // leading FREAK bytes kept (16, 32, 64)
+};
+
+struct FrameMatcher { // persistent descriptor matcher, the previous frame's descriptors stay indexed as train set between frames
+    std::string matcherType;                 // MAT_BF, MAT_FLANN, MAT_MIH, MAT_HNSW
+    std::string descriptorType;              // DES_BINARY, DES_BINARY2, DES_HOG
+    cv::Ptr<cv::DescriptorMatcher> matcher;  // owns the index over the train set
+    bool useHammingKernel;                   // MAT_BF on binary descriptors uses the SIMD Hamming kernel instead of BFMatcher
+    bool useL2U8Kernel;                      // MAT_BF on quantized (uint8) SIFT descriptors uses the integer L2 kernel
+    cv::Mat trainDescriptors;                // train set of the Hamming / integer L2 kernel (previous frame)
+    cv::Mat floatSource, floatCopy;          // last descriptors converted to CV_32F (FLANN KD-tree, HNSW) and their copy
+    MihIndex mihIndex;                       // multi-index hashing tables over the train set (MAT_MIH)
+    HnswIndex hnswIndex;                     // navigable small world graph over the train set (MAT_HNSW)
+    bool hasTrainSet;                        // false until the first frame has been handed over
+    int nIndexBuilds;                        // no. of index builds (one per frame)
+};
+
+void initImagePlanes(ImagePlanes &planes, const cv::Mat &img);
+const cv::Mat &getIntegralImage(ImagePlanes &planes);
+const std::vector<cv::Mat> &getFlowPyramid(ImagePlanes &planes);
+const cv::Mat &getBoxSumImage(ImagePlanes &planes);
+
+typedef void (*KeypointDetectorFn)(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis, const cv::Mat &mask,
+                                   const cv::Ptr<cv::FeatureDetector> &instance); // instance : factory detector, empty to look it up
+
+cv::Ptr<cv::FeatureDetector> getDetector(const std::string &detectorType, int slot=0);
+cv::Ptr<cv::DescriptorExtractor> getDescriptorExtractor(const std::string &descriptorType, int slot=0);
+KeypointDetectorFn getKeypointDetector(const std::string &detectorType, cv::Ptr<cv::FeatureDetector> *instance=nullptr);
+void setBriefParameters(int bytes, bool useOrientation);
+void setDescriptorLengthConfig(const DescriptorLengthConfig &config);
+std::string getDescriptorDataType(const std::string &descriptorType);
+std::string descriptorLengthLabel(const std::string &descriptorType, const DescriptorLengthConfig &config);
+bool setDetectorThreshold(const std::string &detectorType, double threshold);
+void updateThresholdController(ThresholdController &controller, int keypointCount);
+
+void detKeypointsHarris(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis=false, const cv::Mat &mask=cv::Mat(),
+                        const cv::Ptr<cv::FeatureDetector> &instance=cv::Ptr<cv::FeatureDetector>());
+void detKeypointsHarrisOverlapNMS(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img);
+void detKeypointsHarrisUnfused(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img);
+void benchmarkHarrisNMS(std::vector<cv::Mat> &images);
+void detKeypointsORB(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis=false, const cv::Mat &mask=cv::Mat(),
+                     const cv::Ptr<cv::FeatureDetector> &instance=cv::Ptr<cv::FeatureDetector>());
+void detKeypointsAKAZE(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis=false, const cv::Mat &mask=cv::Mat(),
+                       const cv::Ptr<cv::FeatureDetector> &instance=cv::Ptr<cv::FeatureDetector>());
+void detKeypointsSIFT(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis=false, const cv::Mat &mask=cv::Mat(),
+                      const cv::Ptr<cv::FeatureDetector> &instance=cv::Ptr<cv::FeatureDetector>());
+void detKeypointsBRISK(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis=false, const cv::Mat &mask=cv::Mat(),
+                       const cv::Ptr<cv::FeatureDetector> &instance=cv::Ptr<cv::FeatureDetector>());
+void detKeypointsFAST(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis=false, const cv::Mat &mask=cv::Mat(),
+                      const cv::Ptr<cv::FeatureDetector> &instance=cv::Ptr<cv::FeatureDetector>());
+void detKeypointsShiTomasi(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis=false, const cv::Mat &mask=cv::Mat(),
+                           const cv::Ptr<cv::FeatureDetector> &instance=cv::Ptr<cv::FeatureDetector>());
+
+void detKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, std::string detectorType, bool bVis=false, const cv::Mat &mask=cv::Mat());
+void bucketKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Size imgSize, int gridCols, int gridRows, int maxPerCell, int maxTotal);
+void detKeypointsTiled(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, std::string detectorType, int nStrips, bool bVis=false, const cv::Mat &mask=cv::Mat());
+void trackKeypointsKLT(std::vector<cv::KeyPoint> &kptsPrev, ImagePlanes &planesPrev, ImagePlanes &planesCurr,
+                       std::vector<cv::KeyPoint> &kptsCurr, std::vector<cv::DMatch> &matches, float maxFBError);
+int refillKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, KeypointDetectorFn detect,
+                    const cv::Ptr<cv::FeatureDetector> &detector, int gridCols, int gridRows, int minPerCell, int maxPerCell,
+                    const cv::Mat &mask=cv::Mat());
+void detKeypointsModern(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, std::string detectorType, bool bVis=false, const cv::Mat &mask=cv::Mat(),
+                        const cv::Ptr<cv::FeatureDetector> &instance=cv::Ptr<cv::FeatureDetector>());
+void descKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, std::string descriptorType,
+                   const cv::Ptr<cv::DescriptorExtractor> &instance=cv::Ptr<cv::DescriptorExtractor>());
+bool isSinglePassPair(const std::string &detectorType, const std::string &descriptorType);
+void detAndDescKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, std::string featureType, const cv::Mat &mask=cv::Mat(),
+                         const cv::Ptr<cv::Feature2D> &instance=cv::Ptr<cv::Feature2D>());
+void descKeypointsChunked(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, std::string descriptorType, int nChunks);
+void descKeypoints(std::vector<cv::KeyPoint> &keypoints, ImagePlanes &planes, cv::Mat &descriptors, std::string descriptorType,
+                   const cv::Ptr<cv::DescriptorExtractor> &instance=cv::Ptr<cv::DescriptorExtractor>());
+void setLshParameters(int tables, int keySize, int multiProbeLevel);
+void benchmarkLSH(std::vector<cv::Mat> &images, std::string detectorType, std::string descriptorType);
+void setHnswParameters(int M, int efConstruction, int efSearch);
+void benchmarkHnsw(std::vector<cv::Mat> &images, std::string detectorType);
+void benchmarkQuantizedSift(std::vector<cv::Mat> &images, std::string detectorType);
+void computeBoxFlow(DataFrame &prevFrame, DataFrame &currFrame);
+void matchDescriptorsGuided(DataFrame &prevFrame, DataFrame &currFrame, std::vector<cv::DMatch> &matches, std::string descriptorType,
+                            float searchRadius);
+void matchBoxPairs(DataFrame &prevFrame, DataFrame &currFrame, std::map<int, int> &bbMatches, std::string descriptorType,
+                   std::map<int, std::vector<cv::DMatch>> &boxKptMatches);
+void initFrameMatcher(FrameMatcher &frameMatcher, std::string matcherType, std::string descriptorType);
+void matchToPreviousFrame(FrameMatcher &frameMatcher, cv::Mat &descCurr, std::vector<cv::DMatch> &matches, std::string selectorType);
+void advanceFrameMatcher(FrameMatcher &frameMatcher, cv::Mat &descCurr);
 void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::KeyPoint> &kPtsRef, cv::Mat &descSource, cv::Mat &descRef,
                       std::vector<cv::DMatch> &matches, std::string descriptorType, std::string matcherType, std::string selectorType);
 
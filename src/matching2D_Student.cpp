@@ -1,9 +1,345 @@
 
 #include <numeric>
+#include <algorithm>
 #include "matching2D.hpp"
+#include "stageTiming.hpp"
+#include "briefDescriptor.hpp"
 
 using namespace std;
 
+// cached detector / descriptor instances of the factory and detector thresholds set at runtime
+static map<string, cv::Ptr<cv::Feature2D>> featureInstances;
+static map<string, int> detectorThresholds;
+static int briefBytes = 32;               // BRIEF descriptor length in bytes (16, 32 or 64)
+static bool briefUseOrientation = false; // sample the BRIEF pattern rotated by the keypoint angle
+static int akazeDescriptorBits = 0;      // AKAZE descriptor_size in bits (0 : full length of 486 bits)
+static int orbWtaK = 2;                  // ORB WTA_K, 3 and 4 need NORM_HAMMING2
+static int freakBytes = 64;              // leading FREAK bytes kept (16, 32 or 64)
+static int lshTables = 12;               // no. of LSH hash tables of the FLANN matcher for binary descriptors
+static int lshKeySize = 20;              // bits per hash key
+static int lshMultiProbeLevel = 2;       // neighbouring buckets probed per table (0 : plain LSH)
+static int hnswM = 16;                   // max. links per node of the HNSW graph (MAT_HNSW)
+static int hnswEfConstruction = 100;     // candidate list size while building the graph
+static int hnswEfSearch = 64;            // candidate list size while searching (recall / latency trade-off)
+static cv::Mutex featureInstancesMutex;
+
+// window size and no. of pyramid levels of the Lucas-Kanade tracker
+static const cv::Size kltWinSize(21, 21);
+static const int kltMaxLevel = 3;
+static const int refillMinDistance = 7; // min. distance in pixels of a re-detected keypoint to an existing track
+
+// Initialize the planes of a new frame, only the grayscale image is computed here, all other planes are built lazily
+void initImagePlanes(ImagePlanes &planes, const cv::Mat &img)
+{
+    if (img.channels() == 1)
+        planes.gray = img;
+    else
+        cv::cvtColor(img, planes.gray, cv::COLOR_BGR2GRAY);
+    planes.integral.release();
+    planes.flowPyramid.clear();
+    planes.boxSum.release();
+}
+
+// Return the integral image (CV_32S, size + 1) of the grayscale image, it is built on first use
+const cv::Mat &getIntegralImage(ImagePlanes &planes)
+{
+    if (planes.integral.empty())
+        cv::integral(planes.gray, planes.integral, CV_32S);
+    return planes.integral;
+}
+
+// Return the 9x9 box sums (CV_32S, same size as the image) computed from the integral image, the box is clipped at the
+// image border. It is built on first use.
+const cv::Mat &getBoxSumImage(ImagePlanes &planes)
+{
+    if (planes.boxSum.empty())
+    {
+        const cv::Mat &sum = getIntegralImage(planes);
+        int rows = planes.gray.rows, cols = planes.gray.cols;
+        planes.boxSum.create(rows, cols, CV_32S);
+        for (int y = 0; y < rows; ++y)
+        {
+            const int *top = sum.ptr<int>(max(0, y - 4));
+            const int *bottom = sum.ptr<int>(min(rows, y + 5));
+            int *dst = planes.boxSum.ptr<int>(y);
+            for (int x = 0; x < cols; ++x)
+            {
+                int x0 = max(0, x - 4), x1 = min(cols, x + 5);
+                dst[x] = bottom[x1] - bottom[x0] - top[x1] + top[x0];
+            }
+        }
+    }
+    return planes.boxSum;
+}
+
+// Return the Lucas-Kanade pyramid (images and derivatives) of the grayscale image, it is built on first use
+const std::vector<cv::Mat> &getFlowPyramid(ImagePlanes &planes)
+{
+    if (planes.flowPyramid.empty())
+        cv::buildOpticalFlowPyramid(planes.gray, planes.flowPyramid, kltWinSize, kltMaxLevel, true);
+    return planes.flowPyramid;
+}
+
+// Create a configured feature detector (kind "DET") or descriptor extractor (kind "DES") for the given type name
+static cv::Ptr<cv::Feature2D> createFeature2D(const string &kind, const string &type)
+{
+    if (kind == "DET")
+    {
+        auto thresholdIt = detectorThresholds.find(type);
+        if (type == "FAST")
+        {
+            int threshold = 70;           // pixel diff between center and neighbors
+            bool nonmaxSuppression = true;
+            if (thresholdIt != detectorThresholds.end())
+                threshold = thresholdIt->second;
+            return cv::FastFeatureDetector::create(threshold, nonmaxSuppression);
+        }
+        else if (type == "BRISK")
+        {
+            int threshold = 30;           // AGAST detection threshold score (default)
+            if (thresholdIt != detectorThresholds.end())
+                threshold = thresholdIt->second;
+            return cv::BRISK::create(threshold);
+        }
+        else if (type == "ORB")
+            return cv::ORB::create(500, 1.2f, 8, 31, 0, orbWtaK); // WTA_K also applies to detectAndCompute
+        else if (type == "AKAZE")
+            return cv::AKAZE::create(cv::AKAZE::DESCRIPTOR_MLDB, akazeDescriptorBits);
+        else if (type == "SIFT")
+            return cv::xfeatures2d::SIFT::create();
+    }
+    else if (kind == "DES")
+    {
+        if (type == "BRISK")
+        {
+            int threshold = 30;        // FAST/AGAST detection threshold score.
+            int octaves = 3;           // detection octaves (use 0 to do single scale)
+            float patternScale = 1.0f; // apply this scale to the pattern used for sampling the neighbourhood of a keypoint.
+            return cv::BRISK::create(threshold, octaves, patternScale);
+        }
+        else if (type == "BRIEF")
+        {
+            // descriptor length in bytes (16, 32 or 64) and rotated sampling are set with setBriefParameters
+            return cv::xfeatures2d::BriefDescriptorExtractor::create(briefBytes, briefUseOrientation);
+        }
+        else if (type == "ORB")
+            return cv::ORB::create(500, 1.2f, 8, 31, 0, orbWtaK); // default values except WTA_K (setDescriptorLengthConfig)
+        else if (type == "FREAK")
+            return cv::xfeatures2d::FREAK::create(); // use all default values, the length is cut in descKeypoints
+        else if (type == "AKAZE")
+            return cv::AKAZE::create(cv::AKAZE::DESCRIPTOR_MLDB, akazeDescriptorBits); // default values except descriptor_size
+        else if (type == "SIFT")
+            return cv::xfeatures2d::SiftDescriptorExtractor::create(); // use all default values
+    }
+    CV_Error(cv::Error::StsBadArg, "unknown " + string(kind == "DET" ? "detectorType" : "descriptorType") + ": " + type);
+}
+
+// Return the cached instance for a detector / descriptor, it is created on first use and reused for the rest of the run.
+// Different slots hold independent instances of the same configuration, so that parallel jobs never share an instance.
+static cv::Ptr<cv::Feature2D> getFeature2D(const string &kind, const string &type, int slot)
+{
+    cv::AutoLock lock(featureInstancesMutex);
+
+    string key = kind + ":" + type + ":" + to_string(slot);
+    auto it = featureInstances.find(key);
+    if (it == featureInstances.end())
+    {
+        it = featureInstances.insert(make_pair(key, createFeature2D(kind, type))).first;
+    }
+    return it->second;
+}
+
+// Change the detection threshold of all cached instances of a detector (FAST : intensity difference, BRISK : AGAST score).
+// FAST instances are changed in place, BRISK instances are replaced, so callers holding a BRISK instance must fetch it again
+// with getDetector. Returns false if the detector has no adjustable threshold.
+bool setDetectorThreshold(const std::string &detectorType, double threshold)
+{
+    if (detectorType != "FAST" && detectorType != "BRISK")
+        return false;
+
+    cv::AutoLock lock(featureInstancesMutex);
+    int newThreshold = max(1, cvRound(threshold));
+    auto thresholdIt = detectorThresholds.find(detectorType);
+    if (thresholdIt != detectorThresholds.end() && thresholdIt->second == newThreshold)
+        return true;
+    detectorThresholds[detectorType] = newThreshold;
+
+    string prefix = "DET:" + detectorType + ":";
+    for (auto it = featureInstances.begin(); it != featureInstances.end(); ++it)
+    {
+        if (it->first.compare(0, prefix.size(), prefix) != 0)
+            continue;
+        if (detectorType == "FAST")
+            it->second.dynamicCast<cv::FastFeatureDetector>()->setThreshold(newThreshold);
+        else
+            it->second = createFeature2D("DET", detectorType); // BRISK has no threshold setter, its pattern is rebuilt
+    }
+    return true;
+}
+
+// Set descriptor length (16, 32 or 64 bytes) and rotated sampling of both BRIEF extractors (BRIEF, BRIEF_SIMD)
+void setBriefParameters(int bytes, bool useOrientation)
+{
+    if (bytes != 16 && bytes != 32 && bytes != 64)
+        CV_Error(cv::Error::StsBadArg, "BRIEF descriptor length must be 16, 32 or 64 bytes");
+
+    cv::AutoLock lock(featureInstancesMutex);
+    briefBytes = bytes;
+    briefUseOrientation = useOrientation;
+    string prefix = "DES:BRIEF:";
+    for (auto it = featureInstances.begin(); it != featureInstances.end(); ++it)
+    {
+        if (it->first.compare(0, prefix.size(), prefix) == 0)
+            it->second = createFeature2D("DES", "BRIEF");
+    }
+}
+
+// Set the length of all configurable descriptors : BRIEF bytes and orientation, AKAZE descriptor_size, ORB WTA_K and the no.
+// of leading FREAK bytes. Cached detector / extractor instances are rebuilt, the matchers follow through the descriptor
+// size and getDescriptorDataType.
+void setDescriptorLengthConfig(const DescriptorLengthConfig &config)
+{
+    if (config.akazeBits < 0 || config.akazeBits > 486)
+        CV_Error(cv::Error::StsBadArg, "AKAZE descriptor size must be 0 (full) .. 486 bits");
+    if (config.orbWtaK < 2 || config.orbWtaK > 4)
+        CV_Error(cv::Error::StsBadArg, "ORB WTA_K must be 2, 3 or 4");
+    if (config.freakBytes != 16 && config.freakBytes != 32 && config.freakBytes != 64)
+        CV_Error(cv::Error::StsBadArg, "FREAK descriptor length must be 16, 32 or 64 bytes");
+    setBriefParameters(config.briefBytes, config.briefOrientation);
+
+    cv::AutoLock lock(featureInstancesMutex);
+    akazeDescriptorBits = config.akazeBits;
+    orbWtaK = config.orbWtaK;
+    freakBytes = config.freakBytes;
+    const char *rebuilt[] = {"DET:ORB:", "DES:ORB:", "DET:AKAZE:", "DES:AKAZE:"};
+    for (auto it = featureInstances.begin(); it != featureInstances.end(); ++it)
+    {
+        for (int r = 0; r < 4; ++r)
+        {
+            string prefix = rebuilt[r];
+            if (it->first.compare(0, prefix.size(), prefix) == 0)
+                it->second = createFeature2D(prefix.substr(0, 3), prefix.substr(4, prefix.size() - 5));
+        }
+    }
+}
+
+// Descriptor data type used by the matchers : DES_HOG (float, NORM_L2), DES_BINARY2 (ORB with WTA_K 3 / 4, NORM_HAMMING2) or
+// DES_BINARY (NORM_HAMMING)
+std::string getDescriptorDataType(const std::string &descriptorType)
+{
+    if (descriptorType == "SIFT")
+        return "DES_HOG";
+    if (descriptorType == "ORB" && orbWtaK > 2)
+        return "DES_BINARY2";
+    return "DES_BINARY";
+}
+
+// Norm of a descriptor data type (DES_BINARY, DES_BINARY2, DES_HOG)
+static int descriptorNormType(const std::string &descriptorDataType)
+{
+    if (descriptorDataType == "DES_BINARY")
+        return cv::NORM_HAMMING;
+    if (descriptorDataType == "DES_BINARY2")
+        return cv::NORM_HAMMING2;
+    return cv::NORM_L2;
+}
+
+// Short description of the length setting that applies to a descriptor, e.g. "16 bytes" or "32 bytes WTA_K 3"
+std::string descriptorLengthLabel(const std::string &descriptorType, const DescriptorLengthConfig &config)
+{
+    if (descriptorType == "BRIEF" || descriptorType == "BRIEF_SIMD")
+        return to_string(config.briefBytes) + " bytes" + (config.briefOrientation ? " oriented" : "");
+    if (descriptorType == "AKAZE")
+        return config.akazeBits == 0 ? "61 bytes" : to_string((config.akazeBits + 7) / 8) + " bytes";
+    if (descriptorType == "ORB")
+        return "32 bytes WTA_K " + to_string(config.orbWtaK);
+    if (descriptorType == "FREAK")
+        return to_string(config.freakBytes) + " bytes";
+    return "default";
+}
+
+// FREAK orders its point pairs from coarse to fine, a compact descriptor keeps the leading freakBytes bytes
+static void cutDescriptorLength(const std::string &descriptorType, cv::Mat &descriptors)
+{
+    if (descriptorType == "FREAK" && descriptors.cols > freakBytes)
+        descriptors = descriptors.colRange(0, freakBytes).clone();
+}
+
+// Adjust the detector threshold between frames so that the no. of keypoints tracks the target count. The threshold is
+// scaled by (count / target)^gain, the relative change per frame is limited to maxStep to bound the overshoot.
+void updateThresholdController(ThresholdController &controller, int keypointCount)
+{
+    controller.lastCount = keypointCount;
+    double ratio = max(1, keypointCount) / (double)max(1, controller.targetCount);
+    double step = std::pow(ratio, controller.gain);
+    step = min(controller.maxStep, max(1.0 / controller.maxStep, step));
+    controller.threshold = min(controller.maxThreshold, max(controller.minThreshold, controller.threshold * step));
+}
+
+// Feature detector factory (FAST, BRISK, ORB, AKAZE, SIFT), throws cv::Exception for unknown types
+cv::Ptr<cv::FeatureDetector> getDetector(const std::string &detectorType, int slot)
+{
+    return getFeature2D("DET", detectorType, slot);
+}
+
+// Descriptor extractor factory (BRISK, BRIEF, ORB, FREAK, AKAZE, SIFT), throws cv::Exception for unknown types
+cv::Ptr<cv::DescriptorExtractor> getDescriptorExtractor(const std::string &descriptorType, int slot)
+{
+    return getFeature2D("DES", descriptorType, slot);
+}
+
+// Resolve a detector name (SHITOMASI, HARRIS, FAST, BRISK, ORB, AKAZE, SIFT) to its detection function and, if instance
+// is given, to the cached factory instance (empty for HARRIS and SHITOMASI). Throws cv::Exception for unknown names.
+// Resolve once outside the frame loop to keep string compares and the factory lookup off the hot path.
+KeypointDetectorFn getKeypointDetector(const std::string &detectorType, cv::Ptr<cv::FeatureDetector> *instance)
+{
+    static map<string, KeypointDetectorFn> detectorFns = {
+        {"SHITOMASI", detKeypointsShiTomasi},
+        {"HARRIS", detKeypointsHarris},
+        {"FAST", detKeypointsFAST},
+        {"BRISK", detKeypointsBRISK},
+        {"ORB", detKeypointsORB},
+        {"AKAZE", detKeypointsAKAZE},
+        {"SIFT", detKeypointsSIFT}};
+
+    auto it = detectorFns.find(detectorType);
+    if (it == detectorFns.end())
+    {
+        CV_Error(cv::Error::StsBadArg, "unknown detectorType: " + detectorType);
+    }
+    if (instance)
+        *instance = detectorType == "HARRIS" || detectorType == "SHITOMASI" ? cv::Ptr<cv::FeatureDetector>() : getDetector(detectorType);
+    return it->second;
+}
+
+// Set the multi-probe LSH index used by MAT_FLANN for binary descriptors
+void setLshParameters(int tables, int keySize, int multiProbeLevel)
+{
+    if (tables < 1 || keySize < 1 || keySize > 32 || multiProbeLevel < 0)
+        CV_Error(cv::Error::StsBadArg, "invalid LSH parameters");
+    lshTables = tables;
+    lshKeySize = keySize;
+    lshMultiProbeLevel = multiProbeLevel;
+}
+
+// Set the graph and search parameters of MAT_HNSW for float descriptors
+void setHnswParameters(int M, int efConstruction, int efSearch)
+{
+    if (M < 2 || efConstruction < 1 || efSearch < 2)
+        CV_Error(cv::Error::StsBadArg, "invalid HNSW parameters");
+    hnswM = M;
+    hnswEfConstruction = efConstruction;
+    hnswEfSearch = efSearch;
+}
+
+// FLANN matcher : multi-probe LSH directly on binary descriptors (Hamming space), KD-tree for float descriptors (DES_HOG)
+static cv::Ptr<cv::DescriptorMatcher> createFlannMatcher(const std::string &descriptorType)
+{
+    if (descriptorNormType(descriptorType) != cv::NORM_L2) // LSH hashes single bits, for NORM_HAMMING2 it is only a coarser filter
+        return cv::makePtr<cv::FlannBasedMatcher>(cv::makePtr<cv::flann::LshIndexParams>(lshTables, lshKeySize, lshMultiProbeLevel));
+    return cv::DescriptorMatcher::create(cv::DescriptorMatcher::FLANNBASED);
+}
+
 // Find best matches for keypoints in two camera images based on several matching methods
 void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::KeyPoint> &kPtsRef, cv::Mat &descSource, cv::Mat &descRef,
                       std::vector<cv::DMatch> &matches, std::string descriptorType, std::string matcherType, std::string selectorType)
@@ -14,23 +350,24 @@ void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::Key
 
     if (matcherType.compare("MAT_BF") == 0)
     {
-        int normType = descriptorType.compare("DES_BINARY") == 0 ? cv::NORM_HAMMING : cv::NORM_L2;
+        int normType = descriptorNormType(descriptorType);
         matcher = cv::BFMatcher::create(normType, crossCheck);
         cout << "BF matching" << "\n";
     }
     else if (matcherType.compare("MAT_FLANN") == 0)
     {   
-        if (descSource.type() != CV_32F)
-        { // OpenCV bug workaround : convert binary descriptors to floating point due to a bug in current OpenCV implementation
+        // binary descriptors are indexed with LSH as they are, the KD-tree needs floating point descriptors
+        if (descriptorNormType(descriptorType) == cv::NORM_L2 && descSource.type() != CV_32F)
+        {
             descSource.convertTo(descSource, CV_32F);
             descRef.convertTo(descRef, CV_32F);
         }
-        //... TODO : implement FLANN matching
         cout << "FLANN matching" << "\n";
-        matcher = cv::DescriptorMatcher::create(cv::DescriptorMatcher::FLANNBASED);
+        matcher = createFlannMatcher(descriptorType);
     }
 
     // perform matching task
+    double t = (double)cv::getTickCount();
     if (selectorType.compare("SEL_NN") == 0)
     { // nearest neighbor (best match)
 
@@ -41,14 +378,22 @@ void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::Key
         // k nearest neighbors (k=2)
         std::vector<vector<cv::DMatch>> knn_matches;
         // knnMatch: Finds the k best matches for each descriptor from a query set.
-        double t = (double)cv::getTickCount();
         matcher->knnMatch(descSource, descRef, knn_matches, 2);
-        t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-        cout << " (KNN) with n=" << knn_matches.size() << " matches in " << 1000 * t / 1.0 << " ms" << endl;
+        double tKnn = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+        cout << " (KNN) with n=" << knn_matches.size() << " matches in " << 1000 * tKnn / 1.0 << " ms" << endl;
 
         float descriptorDistanceRatio = 0.8;
 
         for (const auto& it : knn_matches ){
+            // knnMatch returns fewer than 2 neighbours if the reference set is that small
+            if (it.empty())
+                continue;
+            if (it.size() < 2)
+            { // no second neighbour to compare with, keep the best match
+                matches.push_back(it[0]);
+                continue;
+            }
+
             // Consider using const for variables that are ensured not to change during the scope of a function.
             const auto d1 = it[0].distance;
             const auto d2 = it[1].distance;
@@ -57,71 +402,1040 @@ void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::Key
             // In order to accept the nearest neighbor as a “match”, d1/d2 ratio should be smaller than a given threshold (something like 0.8). 
             // The motivation behind this test is that we expect a good match to be much closer to the query feature than the second best match.
             // Because if both features are similarly close to the query, we cannot decide which one is really the best one.*/
-            if(d1/d2 < descriptorDistanceRatio){ 
+            if(d1 < descriptorDistanceRatio * d2){ // same as d1/d2 < ratio, but defined for d2 = 0
                 matches.push_back(it[0]);
             }
         }
         cout << "# keypoints removed = " << knn_matches.size() - matches.size() << endl;
         cout << "# total matched points = " << matches.size() << endl;
     }
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    recordStageTime("matcher " + matcherType + " " + selectorType + " " + descriptorType, 1000 * t / 1.0);
 }
 
-// Use one of several types of state-of-art descriptors to uniquely identify keypoints
-void descKeypoints(vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, string descriptorType)
+// Median keypoint displacement (previous -> current frame) of the matches inside every current bounding box. The guided
+// matcher uses it as constant-velocity prediction for the keypoints of that box in the next frame.
+void computeBoxFlow(DataFrame &prevFrame, DataFrame &currFrame)
 {
-    // select appropriate descriptor
-    cv::Ptr<cv::DescriptorExtractor> extractor;
-    if (descriptorType.compare("BRISK") == 0)
+    currFrame.boxFlow.clear();
+    for (auto box = currFrame.boundingBoxes.begin(); box != currFrame.boundingBoxes.end(); ++box)
     {
+        vector<float> dx, dy;
+        for (auto it = currFrame.kptMatches.begin(); it != currFrame.kptMatches.end(); ++it)
+        {
+            const cv::Point2f &ptCurr = currFrame.keypoints[it->trainIdx].pt;
+            if (!box->roi.contains(ptCurr))
+                continue;
+            dx.push_back(ptCurr.x - prevFrame.keypoints[it->queryIdx].pt.x);
+            dy.push_back(ptCurr.y - prevFrame.keypoints[it->queryIdx].pt.y);
+        }
+        if (dx.size() < 3) // too few matches for a robust estimate, the box keeps zero motion
+            continue;
+        std::nth_element(dx.begin(), dx.begin() + dx.size() / 2, dx.end());
+        std::nth_element(dy.begin(), dy.begin() + dy.size() / 2, dy.end());
+        currFrame.boxFlow[box->boxID] = cv::Point2f(dx[dx.size() / 2], dy[dy.size() / 2]);
+    }
+}
 
-        int threshold = 30;        // FAST/AGAST detection threshold score.
-        int octaves = 3;           // detection octaves (use 0 to do single scale)
-        float patternScale = 1.0f; // apply this scale to the pattern used for sampling the neighbourhood of a keypoint.
+// Guided matching : previous keypoints are moved by the flow of their bounding box (zero motion outside of boxes) and
+// bucketed into a grid of searchRadius cells. Every current keypoint is only compared with the previous keypoints predicted
+// within searchRadius, so the cost drops from O(N*M) to O(N*k). Current keypoints with fewer than two candidates in their
+// window or whose window match fails the ratio test fall back to a global search. Ratio test per current keypoint,
+// matches use queryIdx = previous frame and trainIdx = current frame.
+void matchDescriptorsGuided(DataFrame &prevFrame, DataFrame &currFrame, std::vector<cv::DMatch> &matches, std::string descriptorType,
+                            float searchRadius)
+{
+    matches.clear();
+    const cv::Mat &descPrev = prevFrame.descriptors, &descCurr = currFrame.descriptors;
+    if (descPrev.empty() || descCurr.empty())
+        return;
 
-        extractor = cv::BRISK::create(threshold, octaves, patternScale);
+    double t = (double)cv::getTickCount();
+    int normType = descriptorNormType(descriptorType);
+    bool bBinary = normType != cv::NORM_L2;
+    int hammingCellSize = normType == cv::NORM_HAMMING2 ? 2 : 1;
+    bool bQuantized = !bBinary && descCurr.type() == CV_8U; // SIFT descriptors quantized to uint8
+    float descriptorDistanceRatio = 0.8;
+    int nPrev = (int)prevFrame.keypoints.size(), nCurr = (int)currFrame.keypoints.size();
+
+    // predicted positions of the previous keypoints in the current frame
+    vector<cv::Point2f> predicted(nPrev);
+    for (int i = 0; i < nPrev; ++i)
+    {
+        const cv::Point2f &pt = prevFrame.keypoints[i].pt;
+        cv::Point2f flow(0, 0);
+        for (auto box = prevFrame.boundingBoxes.begin(); box != prevFrame.boundingBoxes.end(); ++box)
+        {
+            auto flowIt = prevFrame.boxFlow.find(box->boxID);
+            if (flowIt != prevFrame.boxFlow.end() && box->roi.contains(pt))
+            {
+                flow = flowIt->second;
+                break;
+            }
+        }
+        predicted[i] = pt + flow;
     }
-    else if (descriptorType.compare("BRIEF") == 0){
-        int bytes = 32; // legth of the descriptor in bytes, valid values are: 16, 32 (default) or 64 .
-        bool use_orientation = true; //	sample patterns using keypoints orientation, disabled by default.
-        extractor = cv::xfeatures2d::BriefDescriptorExtractor::create();
+
+    // bucket the predicted positions (counting sort by cell)
+    cv::Size imgSize = currFrame.cameraImg.size();
+    int gridCols = max(1, (int)std::ceil(imgSize.width / searchRadius)), gridRows = max(1, (int)std::ceil(imgSize.height / searchRadius));
+    auto cellX = [&](float x) { return min(gridCols - 1, max(0, (int)std::floor(x / searchRadius))); };
+    auto cellY = [&](float y) { return min(gridRows - 1, max(0, (int)std::floor(y / searchRadius))); };
+    vector<int> cellStart(gridCols * gridRows + 1, 0), cellIds(nPrev);
+    for (int i = 0; i < nPrev; ++i)
+        cellStart[cellY(predicted[i].y) * gridCols + cellX(predicted[i].x) + 1]++;
+    for (int c = 0; c < gridCols * gridRows; ++c)
+        cellStart[c + 1] += cellStart[c];
+    vector<int> cellFill(cellStart.begin(), cellStart.end() - 1);
+    for (int i = 0; i < nPrev; ++i)
+        cellIds[cellFill[cellY(predicted[i].y) * gridCols + cellX(predicted[i].x)]++] = i;
+
+    // windowed search, -1 : no match accepted in the window (too few candidates or rejected by the ratio test)
+    vector<int> bestPrev(nCurr, -1);
+    vector<float> bestDist(nCurr, 0);
+    cv::parallel_for_(cv::Range(0, nCurr), [&](const cv::Range &range) {
+        for (int j = range.start; j < range.end; ++j)
+        {
+            const cv::Point2f &pt = currFrame.keypoints[j].pt;
+            float d1 = std::numeric_limits<float>::max(), d2 = d1;
+            int i1 = -1, nCandidates = 0;
+            for (int cy = cellY(pt.y - searchRadius); cy <= cellY(pt.y + searchRadius); ++cy)
+            {
+                for (int cx = cellX(pt.x - searchRadius); cx <= cellX(pt.x + searchRadius); ++cx)
+                {
+                    int c = cy * gridCols + cx;
+                    for (int k = cellStart[c]; k < cellStart[c + 1]; ++k)
+                    {
+                        int i = cellIds[k];
+                        cv::Point2f diff = predicted[i] - pt;
+                        if (diff.dot(diff) > searchRadius * searchRadius)
+                            continue;
+                        float d = bBinary ? (float)cv::hal::normHamming(descPrev.ptr<uchar>(i), descCurr.ptr<uchar>(j), descCurr.cols, hammingCellSize)
+                                : bQuantized ? std::sqrt((float)cv::normL2Sqr<uchar, int>(descPrev.ptr<uchar>(i), descCurr.ptr<uchar>(j), descCurr.cols))
+                                             : std::sqrt(cv::normL2Sqr<float, float>(descPrev.ptr<float>(i), descCurr.ptr<float>(j), descCurr.cols));
+                        nCandidates++;
+                        if (d < d1) { d2 = d1; d1 = d; i1 = i; }
+                        else if (d < d2) { d2 = d; }
+                    }
+                }
+            }
+            bestPrev[j] = nCandidates >= 2 && d1 < descriptorDistanceRatio * d2 ? i1 : -1;
+            bestDist[j] = d1;
+        }
+    });
+
+    vector<int> globalIdx;
+    for (int j = 0; j < nCurr; ++j)
+    {
+        if (bestPrev[j] >= 0)
+            matches.push_back(cv::DMatch(bestPrev[j], j, bestDist[j]));
+        else
+            globalIdx.push_back(j);
     }
-    else if (descriptorType.compare("ORB") == 0){
-        // use all default values
-        extractor = cv::ORB::create();
+    int nGuided = (int)matches.size();
+
+    // global search for current keypoints whose window gave no match (the prediction may be off, e.g. for a new box)
+    if (!globalIdx.empty())
+    {
+        cv::Mat globalQuery((int)globalIdx.size(), descCurr.cols, descCurr.type());
+        for (size_t k = 0; k < globalIdx.size(); ++k)
+            descCurr.row(globalIdx[k]).copyTo(globalQuery.row((int)k));
+
+        vector<cv::DMatch> globalMatches;
+        if (normType == cv::NORM_HAMMING)
+            matchHammingKnn2(globalQuery, descPrev, globalMatches, descriptorDistanceRatio);
+        else
+        {
+            vector<vector<cv::DMatch>> knnMatches;
+            cv::BFMatcher(normType).knnMatch(globalQuery, descPrev, knnMatches, 2);
+            for (auto it = knnMatches.begin(); it != knnMatches.end(); ++it)
+                if (!it->empty() && (it->size() < 2 || (*it)[0].distance < descriptorDistanceRatio * (*it)[1].distance))
+                    globalMatches.push_back((*it)[0]);
+        }
+        for (auto it = globalMatches.begin(); it != globalMatches.end(); ++it)
+            matches.push_back(cv::DMatch(it->trainIdx, globalIdx[it->queryIdx], it->distance));
+    }
+
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    cout << "Guided matching (radius " << searchRadius << " px) with n= " << nGuided << " guided and " << matches.size() - nGuided
+         << " global matches (" << globalIdx.size() << " keypoints searched globally) in " << 1000 * t / 1.0 << " ms" << endl;
+    recordStageTime("matcher guided " + descriptorType, 1000 * t / 1.0);
+}
+
+// Match descriptors only between the keypoints inside associated bounding boxes (bbMatches : previous -> current box id).
+// Every box pair is a separate job of parallel_for_. The result holds the matches keyed by the current box id (merged if
+// several previous boxes map to it), with frame keypoint indices (queryIdx = previous frame, trainIdx = current frame) and
+// the ratio test applied.
+void matchBoxPairs(DataFrame &prevFrame, DataFrame &currFrame, std::map<int, int> &bbMatches, std::string descriptorType,
+                   std::map<int, std::vector<cv::DMatch>> &boxKptMatches)
+{
+    boxKptMatches.clear();
+    if (prevFrame.descriptors.empty() || currFrame.descriptors.empty())
+        return;
+
+    double t = (double)cv::getTickCount();
+    vector<pair<BoundingBox *, BoundingBox *>> boxPairs;
+    for (auto it = bbMatches.begin(); it != bbMatches.end(); ++it)
+    {
+        BoundingBox *prevBB = nullptr, *currBB = nullptr;
+        for (auto box = prevFrame.boundingBoxes.begin(); box != prevFrame.boundingBoxes.end(); ++box)
+            if (box->boxID == it->first)
+                prevBB = &(*box);
+        for (auto box = currFrame.boundingBoxes.begin(); box != currFrame.boundingBoxes.end(); ++box)
+            if (box->boxID == it->second)
+                currBB = &(*box);
+        if (prevBB && currBB)
+            boxPairs.push_back(make_pair(prevBB, currBB));
+    }
+
+    float descriptorDistanceRatio = 0.8;
+    vector<vector<cv::DMatch>> pairMatches(boxPairs.size());
+    cv::parallel_for_(cv::Range(0, (int)boxPairs.size()), [&](const cv::Range &range) {
+        for (int p = range.start; p < range.end; ++p)
+        {
+            // descriptors of the keypoints inside both boxes
+            vector<int> prevIdx, currIdx;
+            for (int i = 0; i < (int)prevFrame.keypoints.size(); ++i)
+                if (boxPairs[p].first->roi.contains(prevFrame.keypoints[i].pt))
+                    prevIdx.push_back(i);
+            for (int j = 0; j < (int)currFrame.keypoints.size(); ++j)
+                if (boxPairs[p].second->roi.contains(currFrame.keypoints[j].pt))
+                    currIdx.push_back(j);
+            if (prevIdx.empty() || currIdx.empty())
+                continue;
+
+            cv::Mat descPrev((int)prevIdx.size(), prevFrame.descriptors.cols, prevFrame.descriptors.type());
+            cv::Mat descCurr((int)currIdx.size(), currFrame.descriptors.cols, currFrame.descriptors.type());
+            for (size_t k = 0; k < prevIdx.size(); ++k)
+                prevFrame.descriptors.row(prevIdx[k]).copyTo(descPrev.row((int)k));
+            for (size_t k = 0; k < currIdx.size(); ++k)
+                currFrame.descriptors.row(currIdx[k]).copyTo(descCurr.row((int)k));
+
+            // kNN-2 of every current keypoint among the previous keypoints of the partner box
+            vector<cv::DMatch> boxMatches;
+            if (descriptorType == "DES_BINARY")
+                matchHammingKnn2(descCurr, descPrev, boxMatches, descriptorDistanceRatio);
+            else
+            {
+                vector<vector<cv::DMatch>> knnMatches;
+                cv::BFMatcher(descriptorNormType(descriptorType)).knnMatch(descCurr, descPrev, knnMatches, 2);
+                for (auto it = knnMatches.begin(); it != knnMatches.end(); ++it)
+                    if (!it->empty() && (it->size() < 2 || (*it)[0].distance < descriptorDistanceRatio * (*it)[1].distance))
+                        boxMatches.push_back((*it)[0]);
+            }
+            for (auto it = boxMatches.begin(); it != boxMatches.end(); ++it)
+                pairMatches[p].push_back(cv::DMatch(prevIdx[it->trainIdx], currIdx[it->queryIdx], it->distance));
+        }
+    });
+
+    // several previous boxes can be associated with the same current box : merge their matches, a current keypoint matched
+    // in more than one pair keeps its best match
+    for (size_t p = 0; p < boxPairs.size(); ++p)
+    {
+        vector<cv::DMatch> &boxMatches = boxKptMatches[boxPairs[p].second->boxID];
+        boxMatches.insert(boxMatches.end(), pairMatches[p].begin(), pairMatches[p].end());
     }
-    else if (descriptorType.compare("FREAK") == 0){
-        // use all default values
-        extractor = cv::xfeatures2d::FREAK::create();
-        
+    size_t nMatches = 0;
+    for (auto it = boxKptMatches.begin(); it != boxKptMatches.end(); ++it)
+    {
+        vector<cv::DMatch> &boxMatches = it->second;
+        std::sort(boxMatches.begin(), boxMatches.end(), [](const cv::DMatch &a, const cv::DMatch &b) {
+            return a.trainIdx < b.trainIdx || (a.trainIdx == b.trainIdx && a.distance < b.distance);
+        });
+        boxMatches.erase(std::unique(boxMatches.begin(), boxMatches.end(),
+                                     [](const cv::DMatch &a, const cv::DMatch &b) { return a.trainIdx == b.trainIdx; }),
+                         boxMatches.end());
+        nMatches += boxMatches.size();
     }
-    else if (descriptorType.compare("AKAZE") == 0){
-        // use all default values
-        extractor = cv::AKAZE::create();
 
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    cout << "Box-pair matching of " << boxPairs.size() << " box pairs with n= " << nMatches << " matches in " << 1000 * t / 1.0 << " ms" << endl;
+    recordStageTime("matcher box pairs " + descriptorType, 1000 * t / 1.0);
+}
+
+// Create the persistent matcher for a frame sequence (MAT_BF with Hamming or L2 norm, MAT_FLANN with LSH or KD-tree index,
+// MAT_MIH with multi-index hashing for 256-bit binary descriptors, MAT_HNSW with a graph index for float descriptors).
+// MAT_MIH falls back to the Hamming kernel with the first frame if the descriptors are not 32 bytes long.
+void initFrameMatcher(FrameMatcher &frameMatcher, std::string matcherType, std::string descriptorType)
+{
+    frameMatcher.matcherType = matcherType;
+    frameMatcher.descriptorType = descriptorType;
+    frameMatcher.hasTrainSet = false;
+    frameMatcher.nIndexBuilds = 0;
+    frameMatcher.useHammingKernel = matcherType == "MAT_BF" && descriptorType == "DES_BINARY";
+    frameMatcher.useL2U8Kernel = false;
+    if (matcherType == "MAT_BF")
+        frameMatcher.matcher = cv::BFMatcher::create(descriptorNormType(descriptorType), false);
+    else if (matcherType == "MAT_FLANN")
+        frameMatcher.matcher = createFlannMatcher(descriptorType);
+    else if (matcherType == "MAT_MIH")
+    {
+        if (descriptorType != "DES_BINARY")
+            CV_Error(cv::Error::StsBadArg, "MAT_MIH needs binary descriptors (NORM_HAMMING)");
     }
-    else if (descriptorType.compare("SIFT") == 0){
-        // use all default values
-        extractor = cv::xfeatures2d::SiftDescriptorExtractor::create();
+    else if (matcherType == "MAT_HNSW")
+    {
+        if (descriptorType != "DES_HOG")
+            CV_Error(cv::Error::StsBadArg, "MAT_HNSW needs float descriptors");
     }
-    
-    else{ std::cout <<"descriptorType: " <<descriptorType<< " is not an available options" << "\n"; }
+    else
+        CV_Error(cv::Error::StsBadArg, "unknown matcher type " + matcherType);
+}
+
+// FLANN's KD-tree and the HNSW graph need floating point descriptors, non-float descriptors are converted into a copy
+// (LSH takes binary descriptors as they are). The copy is cached, so a frame converted as query is not converted again
+// when it becomes the train set.
+static cv::Mat matcherInput(FrameMatcher &frameMatcher, const cv::Mat &desc)
+{
+    bool bNeedsFloat = frameMatcher.matcherType == "MAT_HNSW" ||
+                       (frameMatcher.matcherType == "MAT_FLANN" && descriptorNormType(frameMatcher.descriptorType) == cv::NORM_L2);
+    if (!bNeedsFloat || desc.type() == CV_32F)
+        return desc;
+    if (frameMatcher.floatSource.data != desc.data || frameMatcher.floatSource.size() != desc.size())
+    {
+        cv::Mat descFloat; // new buffer, the previous copy may still be the train set of the KD-tree
+        desc.convertTo(descFloat, CV_32F);
+        frameMatcher.floatCopy = descFloat;
+        frameMatcher.floatSource = desc; // the reference keeps the source alive, so its data pointer identifies it
+    }
+    return frameMatcher.floatCopy;
+}
+
+// Match the current frame's descriptors (query) against the indexed previous frame (train). The index is not touched, so
+// it is built once per frame in advanceFrameMatcher. Matches are returned with the repo convention
+// queryIdx = previous frame, trainIdx = current frame. With SEL_KNN the ratio test is applied per current keypoint.
+void matchToPreviousFrame(FrameMatcher &frameMatcher, cv::Mat &descCurr, std::vector<cv::DMatch> &matches, std::string selectorType)
+{
+    matches.clear();
+    if (!frameMatcher.hasTrainSet || descCurr.empty())
+        return;
+
+    double t = (double)cv::getTickCount();
+    cv::Mat query = matcherInput(frameMatcher, descCurr);
+    if (frameMatcher.useHammingKernel)
+    { // kNN-2 and ratio test in one pass (ratio 0 keeps the nearest neighbour)
+        if (selectorType != "SEL_NN" && selectorType != "SEL_KNN")
+            CV_Error(cv::Error::StsBadArg, "unknown selector type " + selectorType);
+        matchHammingKnn2(query, frameMatcher.trainDescriptors, matches, selectorType == "SEL_KNN" ? 0.8f : 0.0f);
+    }
+    else if (frameMatcher.useL2U8Kernel)
+    { // integer L2 kernel on quantized SIFT descriptors
+        if (selectorType != "SEL_NN" && selectorType != "SEL_KNN")
+            CV_Error(cv::Error::StsBadArg, "unknown selector type " + selectorType);
+        matchL2U8Knn2(query, frameMatcher.trainDescriptors, matches, selectorType == "SEL_KNN" ? 0.8f : 0.0f);
+    }
+    else if (frameMatcher.matcherType == "MAT_MIH")
+    { // exact kNN-2, identical to brute force
+        if (selectorType != "SEL_NN" && selectorType != "SEL_KNN")
+            CV_Error(cv::Error::StsBadArg, "unknown selector type " + selectorType);
+        matchMihKnn2(frameMatcher.mihIndex, query, matches, selectorType == "SEL_KNN" ? 0.8f : 0.0f);
+    }
+    else if (frameMatcher.matcherType == "MAT_HNSW")
+    { // approximate kNN-2, recall depends on efSearch
+        if (selectorType != "SEL_NN" && selectorType != "SEL_KNN")
+            CV_Error(cv::Error::StsBadArg, "unknown selector type " + selectorType);
+        matchHnswKnn2(frameMatcher.hnswIndex, query, matches, selectorType == "SEL_KNN" ? 0.8f : 0.0f);
+    }
+    else if (selectorType == "SEL_NN")
+    {
+        frameMatcher.matcher->match(query, matches);
+    }
+    else if (selectorType == "SEL_KNN")
+    {
+        vector<vector<cv::DMatch>> knnMatches;
+        frameMatcher.matcher->knnMatch(query, knnMatches, 2);
+        float descriptorDistanceRatio = 0.8;
+        for (auto it = knnMatches.begin(); it != knnMatches.end(); ++it)
+        {
+            if (it->empty())
+                continue;
+            if (it->size() < 2 || (*it)[0].distance < descriptorDistanceRatio * (*it)[1].distance)
+                matches.push_back((*it)[0]);
+        }
+    }
+    else
+        CV_Error(cv::Error::StsBadArg, "unknown selector type " + selectorType);
+
+    for (auto it = matches.begin(); it != matches.end(); ++it)
+    {
+        std::swap(it->queryIdx, it->trainIdx);
+        it->imgIdx = 0;
+    }
+
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    cout << frameMatcher.matcherType << " " << selectorType << " matching with n= " << matches.size() << " matches in "
+         << 1000 * t / 1.0 << " ms" << endl;
+    recordStageTime("matcher " + frameMatcher.matcherType + " " + selectorType + " " + frameMatcher.descriptorType, 1000 * t / 1.0);
+}
+
+// Hand the current frame's descriptors over as train set for the next frame and build the index over them (once per frame)
+void advanceFrameMatcher(FrameMatcher &frameMatcher, cv::Mat &descCurr)
+{
+    frameMatcher.hasTrainSet = !descCurr.empty();
+    if (frameMatcher.matcherType == "MAT_MIH" && !frameMatcher.useHammingKernel && !descCurr.empty() && descCurr.cols != 32)
+    { // the hash tables are built for 256-bit descriptors, other lengths (BRIEF 16 / 64, AKAZE, FREAK) use the Hamming kernel
+        cout << "MAT_MIH needs 32 byte descriptors, matching " << descCurr.cols << " byte descriptors with the Hamming kernel" << endl;
+        frameMatcher.useHammingKernel = true;
+    }
+    frameMatcher.useL2U8Kernel = frameMatcher.matcherType == "MAT_BF" && frameMatcher.descriptorType == "DES_HOG" && descCurr.type() == CV_8U;
+    if (frameMatcher.useHammingKernel || frameMatcher.useL2U8Kernel)
+    { // brute force needs no index, the descriptors are kept as they are
+        frameMatcher.trainDescriptors = descCurr;
+        return;
+    }
+
+    double t = (double)cv::getTickCount();
+    if (frameMatcher.matcherType == "MAT_MIH")
+    {
+        buildMihIndex(frameMatcher.mihIndex, descCurr);
+    }
+    else if (frameMatcher.matcherType == "MAT_HNSW")
+    { // the graph of frame N is the reference of frame N + 1, descriptors are inserted one by one
+        initHnswIndex(frameMatcher.hnswIndex, max(1, descCurr.cols), hnswM, hnswEfConstruction, hnswEfSearch);
+        addToHnswIndex(frameMatcher.hnswIndex, matcherInput(frameMatcher, descCurr));
+    }
+    else
+    {
+        frameMatcher.matcher->clear();
+        if (!frameMatcher.hasTrainSet)
+            return;
+        frameMatcher.matcher->add(vector<cv::Mat>(1, matcherInput(frameMatcher, descCurr)));
+        frameMatcher.matcher->train();
+    }
+    frameMatcher.nIndexBuilds++;
+
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    recordStageTime("matcher index " + frameMatcher.matcherType + " " + frameMatcher.descriptorType, 1000 * t / 1.0);
+}
+
+// Compare multi-probe LSH with exact brute force on consecutive frames : recall (LSH nearest neighbour at the brute-force
+// distance), index build and query time for a few table / key size / probe level settings
+void benchmarkLSH(std::vector<cv::Mat> &images, std::string detectorType, std::string descriptorType)
+{
+    vector<cv::Mat> frameDescriptors;
+    cv::Ptr<cv::FeatureDetector> detector;
+    KeypointDetectorFn detect = getKeypointDetector(detectorType, &detector);
+    cv::Ptr<cv::DescriptorExtractor> extractor = getDescriptorExtractor(descriptorType);
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        vector<cv::KeyPoint> keypoints;
+        cv::Mat descriptors;
+        detect(keypoints, images[i], false, cv::Mat(), detector);
+        descKeypoints(keypoints, images[i], descriptors, descriptorType, extractor);
+        if (descriptors.type() != CV_8U)
+            CV_Error(cv::Error::StsBadArg, "LSH benchmark needs a binary descriptor");
+        frameDescriptors.push_back(descriptors);
+    }
+
+    if (frameDescriptors.size() < 2)
+        return;
+
+    int settings[][3] = {{lshTables, lshKeySize, lshMultiProbeLevel}, {6, 12, 1}, {12, 20, 0}, {20, 16, 2}};
+    cout << "============================================="<<endl;
+    cout << "LSH benchmark (" << detectorType << " / " << descriptorType << ", " << images.size() << " frames)" << endl;
+    for (int s = 0; s < 4; ++s)
+    {
+        double tBuild = 0, tQuery = 0, tBF = 0;
+        int nQuery = 0, nFound = 0;
+        for (size_t i = 1; i < frameDescriptors.size(); ++i)
+        {
+            cv::Mat &train = frameDescriptors[i - 1], &query = frameDescriptors[i];
+            double t = (double)cv::getTickCount();
+            vector<cv::DMatch> bfMatches;
+            matchHammingKnn2(query, train, bfMatches, 0.0f);
+            tBF += ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+            t = (double)cv::getTickCount();
+            cv::FlannBasedMatcher lsh(cv::makePtr<cv::flann::LshIndexParams>(settings[s][0], settings[s][1], settings[s][2]));
+            lsh.add(vector<cv::Mat>(1, train));
+            lsh.train();
+            tBuild += ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+            t = (double)cv::getTickCount();
+            vector<vector<cv::DMatch>> knnMatches;
+            lsh.knnMatch(query, knnMatches, 2);
+            tQuery += ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+            for (size_t q = 0; q < bfMatches.size(); ++q)
+                nFound += !knnMatches[q].empty() && knnMatches[q][0].distance == bfMatches[q].distance;
+            nQuery += bfMatches.size();
+        }
+        double n = frameDescriptors.size() - 1;
+        cout << "tables " << settings[s][0] << ", key size " << settings[s][1] << ", probe level " << settings[s][2] << " : recall "
+             << 100.0 * nFound / max(1, nQuery) << " %, build avg " << 1000 * tBuild / n << " ms, query avg " << 1000 * tQuery / n
+             << " ms (brute force avg " << 1000 * tBF / n << " ms)" << endl;
+    }
+    cout << "============================================="<<endl;
+}
+
+// Compare HNSW with exact brute force (BFMatcher, NORM_L2) on SIFT descriptors of consecutive frames : recall (HNSW nearest
+// neighbour at the brute-force distance), ratio-test survivors, graph build and query time for several efSearch values
+void benchmarkHnsw(std::vector<cv::Mat> &images, std::string detectorType)
+{
+    vector<cv::Mat> frameDescriptors;
+    cv::Ptr<cv::FeatureDetector> detector;
+    KeypointDetectorFn detect = getKeypointDetector(detectorType, &detector);
+    cv::Ptr<cv::DescriptorExtractor> extractor = getDescriptorExtractor("SIFT");
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        vector<cv::KeyPoint> keypoints;
+        cv::Mat descriptors;
+        detect(keypoints, images[i], false, cv::Mat(), detector);
+        descKeypoints(keypoints, images[i], descriptors, "SIFT", extractor);
+        frameDescriptors.push_back(descriptors);
+    }
+
+    if (frameDescriptors.size() < 2)
+        return;
+
+    // exact reference and one graph per frame pair, the graph does not depend on efSearch
+    double tBF = 0, tBuild = 0;
+    int nQuery = 0, nRatioBF = 0;
+    vector<vector<cv::DMatch>> bfMatches(frameDescriptors.size());
+    vector<HnswIndex> graphs(frameDescriptors.size());
+    for (size_t i = 1; i < frameDescriptors.size(); ++i)
+    {
+        cv::Mat &train = frameDescriptors[i - 1], &query = frameDescriptors[i];
+        double t = (double)cv::getTickCount();
+        vector<vector<cv::DMatch>> knnMatches;
+        cv::BFMatcher(cv::NORM_L2).knnMatch(query, train, knnMatches, 2);
+        tBF += ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+        for (auto it = knnMatches.begin(); it != knnMatches.end(); ++it)
+        {
+            bfMatches[i].push_back(it->empty() ? cv::DMatch() : (*it)[0]);
+            nRatioBF += !it->empty() && (it->size() < 2 || (*it)[0].distance < 0.8f * (*it)[1].distance);
+        }
+        nQuery += query.rows;
+
+        t = (double)cv::getTickCount();
+        initHnswIndex(graphs[i], train.cols, hnswM, hnswEfConstruction, hnswEfSearch);
+        addToHnswIndex(graphs[i], train);
+        tBuild += ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    }
+
+    double n = frameDescriptors.size() - 1;
+    int efOptions[] = {16, 32, 64, 128};
+    cout << "============================================="<<endl;
+    cout << "HNSW benchmark (" << detectorType << " / SIFT, " << images.size() << " frames, M " << hnswM << ", efConstruction "
+         << hnswEfConstruction << ")" << endl;
+    cout << "brute force avg " << 1000 * tBF / n << " ms, ratio test survivors " << nRatioBF << ", graph build avg " << 1000 * tBuild / n
+         << " ms" << endl;
+    for (int e = 0; e < 4; ++e)
+    {
+        double tQuery = 0;
+        int nFound = 0, nRatio = 0;
+        for (size_t i = 1; i < frameDescriptors.size(); ++i)
+        {
+            graphs[i].efSearch = efOptions[e];
+            double t = (double)cv::getTickCount();
+            vector<cv::DMatch> nnMatches, ratioMatches;
+            matchHnswKnn2(graphs[i], frameDescriptors[i], nnMatches, 0.0f);
+            tQuery += ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+            matchHnswKnn2(graphs[i], frameDescriptors[i], ratioMatches, 0.8f);
+
+            for (auto it = nnMatches.begin(); it != nnMatches.end(); ++it)
+                nFound += it->distance <= bfMatches[i][it->queryIdx].distance * (1 + 1e-5f);
+            nRatio += ratioMatches.size();
+        }
+        cout << "efSearch " << efOptions[e] << " : recall " << 100.0 * nFound / max(1, nQuery) << " %, ratio test survivors " << nRatio
+             << ", query avg " << 1000 * tQuery / n << " ms" << endl;
+    }
+    cout << "============================================="<<endl;
+}
+
+// Compare matching of quantized (uint8) SIFT descriptors with float brute force (BFMatcher, NORM_L2) on consecutive frames :
+// descriptor memory, quantization error, agreement of the nearest neighbours, ratio-test survivors and matching time of the
+// integer L2 kernel with and without float re-ranking of the two best candidates
+void benchmarkQuantizedSift(std::vector<cv::Mat> &images, std::string detectorType)
+{
+    vector<cv::Mat> frameDescriptors, frameQuantized;
+    size_t floatBytes = 0, quantizedBytes = 0;
+    double maxError = 0;
+    cv::Ptr<cv::FeatureDetector> detector;
+    KeypointDetectorFn detect = getKeypointDetector(detectorType, &detector);
+    cv::Ptr<cv::DescriptorExtractor> extractor = getDescriptorExtractor("SIFT");
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        vector<cv::KeyPoint> keypoints;
+        cv::Mat descriptors, quantized, dequantized;
+        detect(keypoints, images[i], false, cv::Mat(), detector);
+        descKeypoints(keypoints, images[i], descriptors, "SIFT", extractor);
+        quantizeDescriptors(descriptors, quantized);
+        quantized.convertTo(dequantized, CV_32F);
+        if (!descriptors.empty())
+            maxError = max(maxError, cv::norm(descriptors, dequantized, cv::NORM_INF));
+        floatBytes += descriptors.total() * descriptors.elemSize();
+        quantizedBytes += quantized.total() * quantized.elemSize();
+        frameDescriptors.push_back(descriptors);
+        frameQuantized.push_back(quantized);
+    }
+
+    if (frameDescriptors.size() < 2)
+        return;
+
+    double tFloat = 0, tInt = 0, tRerank = 0;
+    int nFloat = 0, nInt = 0, nRerank = 0, nQuery = 0, nSameNN = 0;
+    for (size_t i = 1; i < frameDescriptors.size(); ++i)
+    {
+        double t = (double)cv::getTickCount();
+        vector<vector<cv::DMatch>> knnMatches;
+        cv::BFMatcher(cv::NORM_L2).knnMatch(frameDescriptors[i], frameDescriptors[i - 1], knnMatches, 2);
+        vector<cv::DMatch> floatMatches;
+        for (auto it = knnMatches.begin(); it != knnMatches.end(); ++it)
+            if (!it->empty() && (it->size() < 2 || (*it)[0].distance < 0.8f * (*it)[1].distance))
+                floatMatches.push_back((*it)[0]);
+        tFloat += ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+        t = (double)cv::getTickCount();
+        vector<cv::DMatch> intMatches;
+        matchL2U8Knn2(frameQuantized[i], frameQuantized[i - 1], intMatches, 0.8f);
+        tInt += ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+        t = (double)cv::getTickCount();
+        vector<cv::DMatch> rerankMatches;
+        matchL2U8Knn2(frameQuantized[i], frameQuantized[i - 1], rerankMatches, 0.8f, frameDescriptors[i], frameDescriptors[i - 1]);
+        tRerank += ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+        vector<cv::DMatch> nnMatches;
+        matchL2U8Knn2(frameQuantized[i], frameQuantized[i - 1], nnMatches, 0.0f);
+        for (size_t q = 0; q < nnMatches.size(); ++q)
+            nSameNN += !knnMatches[q].empty() && knnMatches[q][0].trainIdx == nnMatches[q].trainIdx;
+
+        nFloat += floatMatches.size();
+        nInt += intMatches.size();
+        nRerank += rerankMatches.size();
+        nQuery += frameDescriptors[i].rows;
+    }
+
+    double n = frameDescriptors.size() - 1;
+    cout << "============================================="<<endl;
+    cout << "Quantized SIFT benchmark (" << detectorType << " / SIFT, " << images.size() << " frames, kernel : " << l2U8KernelName() << ")" << endl;
+    cout << "descriptor memory " << floatBytes / 1024 << " KB float, " << quantizedBytes / 1024 << " KB uint8, max. quantization error "
+         << maxError << endl;
+    cout << "nearest neighbour identical for " << nSameNN << " of " << nQuery << " queries" << endl;
+    cout << "float BFMatcher : ratio test survivors " << nFloat << ", avg " << 1000 * tFloat / n << " ms" << endl;
+    cout << "uint8 kernel : ratio test survivors " << nInt << " (" << showpos << nInt - nFloat << noshowpos << "), avg " << 1000 * tInt / n
+         << " ms" << endl;
+    cout << "uint8 kernel + float re-ranking : ratio test survivors " << nRerank << " (" << showpos << nRerank - nFloat << noshowpos
+         << "), avg " << 1000 * tRerank / n << " ms" << endl;
+    cout << "============================================="<<endl;
+}
+
+// Use one of several types of state-of-art descriptors to uniquely identify keypoints
+void descKeypoints(vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, string descriptorType,
+                   const cv::Ptr<cv::DescriptorExtractor> &instance)
+{
+    // get configured descriptor extractor (resolved once per combination by the caller, created once per run)
+    cv::Ptr<cv::DescriptorExtractor> extractor = instance.empty() ? getDescriptorExtractor(descriptorType) : instance;
 
     // perform feature description
     double t = (double)cv::getTickCount();
     extractor->compute(img, keypoints, descriptors);
+    cutDescriptorLength(descriptorType, descriptors);
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    cout << descriptorType << " descriptor extraction in " << 1000 * t / 1.0 << " ms" << endl;
+    recordStageTime("descriptor " + descriptorType, 1000 * t / 1.0);
+}
+
+// Extractors whose cost is dominated by the per-keypoint work, so every chunk repeats only a small image-wide setup : BRIEF,
+// FREAK and BRISK build an integral image, ORB a small pyramid (about 0.5 - 1.4 ms per chunk on a KITTI frame). AKAZE and
+// SIFT rebuild their scale space on every compute() call (about 40 ms per chunk), 4 chunks need 2.4 - 3x the CPU time for
+// at most 1.3 - 1.6x lower latency, so they run unchunked.
+static bool isChunkableDescriptor(const std::string &descriptorType)
+{
+    return descriptorType == "BRIEF" || descriptorType == "FREAK" || descriptorType == "BRISK" || descriptorType == "ORB";
+}
+
+// Extract descriptors concurrently : the keypoints are split into nChunks contiguous chunks, every chunk runs on its own
+// extractor instance (factory slot) and writes into its row range of one descriptor matrix allocated up front. Extractors
+// that remove keypoints (e.g. too close to the border) leave their chunk in a separate matrix, in that case keypoints
+// and descriptors are compacted afterwards. Extractors with image-wide setup (see isChunkableDescriptor) run unchunked.
+void descKeypointsChunked(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, std::string descriptorType, int nChunks)
+{
+    int nKpts = (int)keypoints.size();
+    // at least 64 keypoints per chunk, chunks beyond the no. of threads only add setup work
+    nChunks = min(min(nChunks, nKpts / 64), cv::getNumThreads());
+    if (nChunks <= 1 || !isChunkableDescriptor(descriptorType))
+    {
+        descKeypoints(keypoints, img, descriptors, descriptorType);
+        return;
+    }
+
+    double t = (double)cv::getTickCount();
+    cv::Ptr<cv::DescriptorExtractor> extractor = getDescriptorExtractor(descriptorType);
+    cv::Mat allDescriptors(nKpts, extractor->descriptorSize(), extractor->descriptorType());
+    vector<vector<cv::KeyPoint>> chunkKpts(nChunks);
+    vector<cv::Mat> chunkDesc(nChunks);
+
+    cv::parallel_for_(cv::Range(0, nChunks), [&](const cv::Range &range) {
+        for (int c = range.start; c < range.end; ++c)
+        {
+            int first = c * nKpts / nChunks, last = (c + 1) * nKpts / nChunks;
+            chunkKpts[c].assign(keypoints.begin() + first, keypoints.begin() + last);
+            chunkDesc[c] = allDescriptors.rowRange(first, last); // compute() writes in place as long as no keypoint is removed
+            getDescriptorExtractor(descriptorType, c)->compute(img, chunkKpts[c], chunkDesc[c]);
+        }
+    });
+
+    // compact if an extractor removed keypoints (its descriptors were then written to a new matrix)
+    bool bCompact = false;
+    for (int c = 0; c < nChunks; ++c)
+    {
+        int first = c * nKpts / nChunks, last = (c + 1) * nKpts / nChunks;
+        bCompact |= (int)chunkKpts[c].size() != last - first || chunkDesc[c].data != allDescriptors.ptr(first);
+    }
+    if (bCompact)
+    {
+        keypoints.clear();
+        vector<cv::Mat> keptDesc;
+        for (int c = 0; c < nChunks; ++c)
+        {
+            keypoints.insert(keypoints.end(), chunkKpts[c].begin(), chunkKpts[c].end());
+            if (!chunkKpts[c].empty())
+                keptDesc.push_back(chunkDesc[c]);
+        }
+        if (keptDesc.empty())
+            descriptors.release();
+        else
+            cv::vconcat(keptDesc, descriptors);
+    }
+    else
+        descriptors = allDescriptors;
+    cutDescriptorLength(descriptorType, descriptors);
+
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    cout << descriptorType << " descriptor extraction in " << nChunks << " chunks (n= " << keypoints.size() << " of " << nKpts
+         << " keypoints kept) in " << 1000 * t / 1.0 << " ms" << endl;
+    recordStageTime("descriptor " + descriptorType + " chunked", 1000 * t / 1.0);
+}
+
+// Describe keypoints on the frame planes : the in-tree BRIEF (BRIEF_SIMD) reads the cached box sums, all other descriptors
+// run on the grayscale image
+void descKeypoints(std::vector<cv::KeyPoint> &keypoints, ImagePlanes &planes, cv::Mat &descriptors, std::string descriptorType,
+                   const cv::Ptr<cv::DescriptorExtractor> &instance)
+{
+    if (descriptorType != "BRIEF_SIMD")
+    {
+        descKeypoints(keypoints, planes.gray, descriptors, descriptorType, instance);
+        return;
+    }
+
+    double t = (double)cv::getTickCount();
+    describeBRIEF(keypoints, planes, descriptors, briefBytes, briefUseOrientation);
     t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
     cout << descriptorType << " descriptor extraction in " << 1000 * t / 1.0 << " ms" << endl;
+    recordStageTime("descriptor " + descriptorType, 1000 * t / 1.0);
+}
+
+// Detector / descriptor pairs of the same family that can be computed in a single pass (ORB, AKAZE, BRISK, SIFT)
+bool isSinglePassPair(const std::string &detectorType, const std::string &descriptorType)
+{
+    return detectorType == descriptorType &&
+           (detectorType == "ORB" || detectorType == "AKAZE" || detectorType == "BRISK" || detectorType == "SIFT");
+}
+
+// Detect keypoints and compute their descriptors in one call on the cached detector instance, so the scale space
+// (and for AKAZE the nonlinear diffusion) is built only once per frame
+void detAndDescKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, std::string featureType, const cv::Mat &mask,
+                         const cv::Ptr<cv::Feature2D> &instance)
+{
+    if (!isSinglePassPair(featureType, featureType))
+        CV_Error(cv::Error::StsBadArg, "detectAndCompute is not supported for feature type " + featureType);
+
+    // the detector instance carries the threshold set by the keypoint budget controller
+    cv::Ptr<cv::Feature2D> feature = instance.empty() ? getDetector(featureType) : instance;
+
+    double t = (double)cv::getTickCount();
+    feature->detectAndCompute(img, mask, keypoints, descriptors);
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    cout << featureType << " detect+describe with n= " << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+    recordStageTime("detect+describe " + featureType, 1000 * t / 1.0);
+}
+
+// Detect keypoints in image with the detector selected by name (SHITOMASI, HARRIS, FAST, BRISK, ORB, AKAZE, SIFT)
+void detKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, std::string detectorType, bool bVis, const cv::Mat &mask)
+{
+    getKeypointDetector(detectorType)(keypoints, img, bVis, mask, cv::Ptr<cv::FeatureDetector>());
+}
+
+// Detect keypoints in image with any detector provided by the factory (FAST, BRISK, ORB, AKAZE, SIFT)
+void detKeypointsModern(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, std::string detectorType, bool bVis, const cv::Mat &mask,
+                        const cv::Ptr<cv::FeatureDetector> &instance)
+{
+    cv::Ptr<cv::FeatureDetector> detector = instance.empty() ? getDetector(detectorType) : instance;
+    double t = (double)cv::getTickCount();
+    detector->detect(img, keypoints, mask);
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    cout << detectorType << " detector with n= " << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+    recordStageTime("detector " + detectorType, 1000 * t / 1.0);
+
+    // visualize results
+    if (bVis)
+    {
+        cv::Mat visImage = img.clone();
+        cv::drawKeypoints(img, keypoints, visImage, cv::Scalar::all(-1), cv::DrawMatchesFlags::DRAW_RICH_KEYPOINTS);
+        string windowName = detectorType + " Detector Results";
+        cv::namedWindow(windowName, 7);
+        imshow(windowName, visImage);
+        cv::waitKey(0);
+    }
+}
+
+// Spatially bucketed keypoint selection : the image is divided into gridCols x gridRows cells, in every cell only the
+// maxPerCell strongest keypoints (by response) are kept and the total is capped at maxTotal. Uses partial selection
+// (nth_element) instead of sorting, so the cost is linear in the no. of keypoints.
+void bucketKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Size imgSize, int gridCols, int gridRows, int maxPerCell, int maxTotal)
+{
+    double t = (double)cv::getTickCount();
+    int nCells = gridCols * gridRows;
+    size_t nBefore = keypoints.size();
+    auto strongerResponse = [](const cv::KeyPoint &a, const cv::KeyPoint &b) { return a.response > b.response; };
+
+    // group keypoints by cell (counting sort)
+    vector<int> cellOf(keypoints.size());
+    vector<int> cellStart(nCells + 1, 0);
+    for (size_t i = 0; i < keypoints.size(); ++i)
+    {
+        int cx = min(gridCols - 1, max(0, (int)(keypoints[i].pt.x * gridCols / imgSize.width)));
+        int cy = min(gridRows - 1, max(0, (int)(keypoints[i].pt.y * gridRows / imgSize.height)));
+        cellOf[i] = cy * gridCols + cx;
+        cellStart[cellOf[i] + 1]++;
+    }
+    for (int c = 0; c < nCells; ++c)
+        cellStart[c + 1] += cellStart[c];
+
+    vector<cv::KeyPoint> grouped(keypoints.size());
+    vector<int> cellFill(cellStart.begin(), cellStart.end() - 1);
+    for (size_t i = 0; i < keypoints.size(); ++i)
+        grouped[cellFill[cellOf[i]]++] = keypoints[i];
+
+    // keep the strongest keypoints per cell
+    keypoints.clear();
+    for (int c = 0; c < nCells; ++c)
+    {
+        auto first = grouped.begin() + cellStart[c], last = grouped.begin() + cellStart[c + 1];
+        if (last - first > maxPerCell)
+        {
+            std::nth_element(first, first + maxPerCell, last, strongerResponse);
+            last = first + maxPerCell;
+        }
+        keypoints.insert(keypoints.end(), first, last);
+    }
+
+    // cap the total
+    if ((int)keypoints.size() > maxTotal)
+    {
+        std::nth_element(keypoints.begin(), keypoints.begin() + maxTotal, keypoints.end(), strongerResponse);
+        keypoints.resize(maxTotal);
+    }
+
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    cout << "Bucketing (" << gridCols << "x" << gridRows << " cells, " << maxPerCell << " per cell, max " << maxTotal << ") kept "
+         << keypoints.size() << " of " << nBefore << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+}
+
+// Track keypoints of the previous frame into the current frame with pyramidal Lucas-Kanade. Every track is verified by
+// tracking it back into the previous frame, tracks that do not return within maxFBError pixels are dropped. Matches use
+// the previous frame as query and the current frame as train, like matchDescriptors.
+void trackKeypointsKLT(std::vector<cv::KeyPoint> &kptsPrev, ImagePlanes &planesPrev, ImagePlanes &planesCurr,
+                       std::vector<cv::KeyPoint> &kptsCurr, std::vector<cv::DMatch> &matches, float maxFBError)
+{
+    kptsCurr.clear();
+    matches.clear();
+    if (kptsPrev.empty())
+        return;
+
+    double t = (double)cv::getTickCount();
+    const vector<cv::Mat> &pyrPrev = getFlowPyramid(planesPrev);
+    const vector<cv::Mat> &pyrCurr = getFlowPyramid(planesCurr);
+
+    vector<cv::Point2f> ptsPrev, ptsCurr, ptsBack;
+    cv::KeyPoint::convert(kptsPrev, ptsPrev);
+    vector<uchar> status, statusBack;
+    vector<float> err;
+    cv::TermCriteria criteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30, 0.01);
+
+    // forward and backward tracking, the backward pass starts at the tracked position without any prior so a drifted track
+    // cannot be pulled back to its origin
+    cv::calcOpticalFlowPyrLK(pyrPrev, pyrCurr, ptsPrev, ptsCurr, status, err, kltWinSize, kltMaxLevel, criteria);
+    cv::calcOpticalFlowPyrLK(pyrCurr, pyrPrev, ptsCurr, ptsBack, statusBack, err, kltWinSize, kltMaxLevel, criteria);
+
+    cv::Rect imgRect(0, 0, planesCurr.gray.cols, planesCurr.gray.rows);
+    for (size_t i = 0; i < ptsPrev.size(); ++i)
+    {
+        float fbError = (float)cv::norm(ptsBack[i] - ptsPrev[i]);
+        if (!status[i] || !statusBack[i] || fbError > maxFBError || !imgRect.contains(ptsCurr[i]))
+            continue;
+
+        cv::KeyPoint kpt = kptsPrev[i];
+        kpt.pt = ptsCurr[i];
+        kptsCurr.push_back(kpt);
+        matches.push_back(cv::DMatch((int)i, (int)kptsCurr.size() - 1, fbError));
+    }
+
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    cout << "KLT tracking kept " << kptsCurr.size() << " of " << kptsPrev.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+    recordStageTime("KLT tracking", 1000 * t / 1.0);
+}
+
+// Re-detect keypoints in the grid cells that hold fewer than minPerCell (tracked) keypoints, away from the existing tracks.
+// The strongest new keypoints are appended until such a cell holds maxPerCell keypoints. Returns the no. of added keypoints.
+int refillKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, KeypointDetectorFn detect,
+                    const cv::Ptr<cv::FeatureDetector> &detector, int gridCols, int gridRows, int minPerCell, int maxPerCell,
+                    const cv::Mat &mask)
+{
+    auto cellIndex = [&](const cv::Point2f &pt) {
+        int cx = min(gridCols - 1, max(0, (int)(pt.x * gridCols / img.cols)));
+        int cy = min(gridRows - 1, max(0, (int)(pt.y * gridRows / img.rows)));
+        return cy * gridCols + cx;
+    };
+
+    vector<int> cellCount(gridCols * gridRows, 0);
+    for (auto it = keypoints.begin(); it != keypoints.end(); ++it)
+        cellCount[cellIndex(it->pt)]++;
+
+    // detection mask covering the cells that lost tracks
+    cv::Mat refillMask = cv::Mat::zeros(img.size(), CV_8U);
+    int nRefillCells = 0;
+    for (int cy = 0; cy < gridRows; ++cy)
+    {
+        for (int cx = 0; cx < gridCols; ++cx)
+        {
+            if (cellCount[cy * gridCols + cx] >= minPerCell)
+                continue;
+            int x0 = cx * img.cols / gridCols, x1 = (cx + 1) * img.cols / gridCols;
+            int y0 = cy * img.rows / gridRows, y1 = (cy + 1) * img.rows / gridRows;
+            refillMask(cv::Rect(x0, y0, x1 - x0, y1 - y0)).setTo(255);
+            nRefillCells++;
+        }
+    }
+    if (nRefillCells == 0)
+        return 0;
+    if (!mask.empty())
+        refillMask &= mask;
+
+    // no re-detection next to a track, otherwise the same corner is tracked twice
+    for (auto it = keypoints.begin(); it != keypoints.end(); ++it)
+        cv::circle(refillMask, it->pt, refillMinDistance, cv::Scalar(0), -1);
+
+    vector<cv::KeyPoint> newKeypoints;
+    detect(newKeypoints, img, false, refillMask, detector);
+    cv::KeyPointsFilter::runByPixelsMask(newKeypoints, refillMask);
+
+    // strongest first, so every refilled cell gets its best keypoints
+    std::sort(newKeypoints.begin(), newKeypoints.end(),
+              [](const cv::KeyPoint &a, const cv::KeyPoint &b) { return a.response > b.response; });
+    int nAdded = 0;
+    for (auto it = newKeypoints.begin(); it != newKeypoints.end(); ++it)
+    {
+        int &count = cellCount[cellIndex(it->pt)];
+        if (count >= maxPerCell)
+            continue;
+        keypoints.push_back(*it);
+        count++;
+        nAdded++;
+    }
+
+    cout << "Re-detection in " << nRefillCells << " of " << gridCols * gridRows << " cells added " << nAdded << " keypoints" << endl;
+    return nAdded;
+}
+
+// Border in pixels a detector needs around a keypoint (incl. its coarsest pyramid level) to give the same result on an
+// image strip as on the full image
+static int detectorBorder(const string &detectorType)
+{
+    if (detectorType == "FAST")
+        return 4;  // Bresenham circle of radius 3 + 3x3 non-maximum suppression
+    else
+        return 64; // BRISK, AKAZE, SIFT : scale space over several octaves
+}
+
+// Detect keypoints with a factory detector on horizontal image strips in parallel. Every strip owns a range of rows and
+// is processed together with an overlap of the detector border above and below, so keypoints close to a strip boundary
+// are found with the same neighbourhood as on the full image. Keypoints detected inside the overlap belong to the
+// neighbouring strip and are dropped, which removes all duplicates. The no. of strips is limited so the overlap does not
+// dominate. Detectors which are not provided by the factory (HARRIS, SHITOMASI) run untiled, ORB as well : it keeps the
+// best keypoints of the whole image and needs a border of 112 px (edgeThreshold 31 at scale 1.2^7), so a 375 px high KITTI
+// frame cannot be split.
+void detKeypointsTiled(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, std::string detectorType, int nStrips, bool bVis, const cv::Mat &mask)
+{
+    if (detectorType == "HARRIS" || detectorType == "SHITOMASI" || detectorType == "ORB")
+    {
+        getKeypointDetector(detectorType)(keypoints, img, bVis, mask, cv::Ptr<cv::FeatureDetector>());
+        return;
+    }
+
+    // every strip owns at least twice the border in rows, otherwise the overlap dominates the work
+    int border = detectorBorder(detectorType);
+    int maxStrips = max(1, img.rows / (2 * border));
+    if (nStrips > maxStrips)
+    {
+        cout << detectorType << " tiled detector : " << nStrips << " strips reduced to " << maxStrips << " (border " << border
+             << " px, image height " << img.rows << " px)" << endl;
+        nStrips = maxStrips;
+    }
+    nStrips = max(1, nStrips);
+
+    vector<vector<cv::KeyPoint>> stripKeypoints(nStrips);
+    vector<double> stripTimes(nStrips);
+
+    double t = (double)cv::getTickCount();
+    cv::parallel_for_(cv::Range(0, nStrips), [&](const cv::Range &range) {
+        for (int strip = range.start; strip < range.end; strip++)
+        {
+            double tStrip = (double)cv::getTickCount();
+
+            // owned rows and rows processed incl. overlap
+            int y0 = strip * img.rows / nStrips, y1 = (strip + 1) * img.rows / nStrips;
+            int yStart = max(0, y0 - border), yEnd = min(img.rows, y1 + border);
+
+            vector<cv::KeyPoint> kpts;
+            cv::Mat stripMask = mask.empty() ? cv::Mat() : mask.rowRange(yStart, yEnd);
+            getDetector(detectorType, strip)->detect(img.rowRange(yStart, yEnd), kpts, stripMask);
+
+            for (auto it = kpts.begin(); it != kpts.end(); ++it)
+            {
+                it->pt.y += yStart;
+                if (it->pt.y >= y0 && it->pt.y < y1)
+                    stripKeypoints[strip].push_back(*it);
+            }
+            stripTimes[strip] = ((double)cv::getTickCount() - tStrip) / cv::getTickFrequency();
+        }
+    }, nStrips);
+
+    for (auto it = stripKeypoints.begin(); it != stripKeypoints.end(); ++it)
+        keypoints.insert(keypoints.end(), it->begin(), it->end());
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+    cout << detectorType << " tiled detector (" << nStrips << " strips, border " << border << ") with n= " << keypoints.size()
+         << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+    for (int strip = 0; strip < nStrips; strip++)
+        cout << "  strip " << strip << " : n= " << stripKeypoints[strip].size() << " in " << 1000 * stripTimes[strip] << " ms" << endl;
+    recordStageTime("detector " + detectorType + " tiled", 1000 * t / 1.0);
+
+    // visualize results
+    if (bVis)
+    {
+        cv::Mat visImage = img.clone();
+        cv::drawKeypoints(img, keypoints, visImage, cv::Scalar::all(-1), cv::DrawMatchesFlags::DRAW_RICH_KEYPOINTS);
+        string windowName = detectorType + " Tiled Detector Results";
+        cv::namedWindow(windowName, 7);
+        imshow(windowName, visImage);
+        cv::waitKey(0);
+    }
 }
 
 // Detect keypoints in image using ORB detector
-void detKeypointsORB(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis){
-    // Create ORB detector
-    cv::Ptr<cv::FeatureDetector> detector = cv::ORB::create();
+void detKeypointsORB(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis, const cv::Mat &mask,
+                     const cv::Ptr<cv::FeatureDetector> &instance){
+    // Get ORB detector
+    cv::Ptr<cv::FeatureDetector> detector = instance.empty() ? getDetector("ORB") : instance;
     double t = (double)cv::getTickCount();
     // ORB detector input
     // - (input image, extracted keypoints)
-    detector->detect(img, keypoints);
+    detector->detect(img, keypoints, mask);
     t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    recordStageTime("detector ORB", 1000 * t / 1.0);
     cout << "ORB detector with n= " << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
 
     // visualize results
@@ -136,14 +1450,16 @@ void detKeypointsORB(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bV
     }
 }
 // Detect keypoints in image using AKAZE detector
-void detKeypointsAKAZE(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis){
-     // Create AKAZE detector
-    cv::Ptr<cv::FeatureDetector> detector = cv::AKAZE::create();
+void detKeypointsAKAZE(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis, const cv::Mat &mask,
+                       const cv::Ptr<cv::FeatureDetector> &instance){
+     // Get AKAZE detector
+    cv::Ptr<cv::FeatureDetector> detector = instance.empty() ? getDetector("AKAZE") : instance;
     double t = (double)cv::getTickCount();
     // AKAZE detector input
     // - (input image, extracted keypoints)
-    detector->detect(img, keypoints);
+    detector->detect(img, keypoints, mask);
     t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    recordStageTime("detector AKAZE", 1000 * t / 1.0);
     cout << "AKAZE detector with n= " << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
 
     // visualize results
@@ -158,14 +1474,16 @@ void detKeypointsAKAZE(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool
     }
 }
 // Detect keypoints in image using SIFT detector
-void detKeypointsSIFT(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis){
-     // Create SIFT detector
-    cv::Ptr<cv::FeatureDetector> detector = cv::xfeatures2d::SIFT::create();
+void detKeypointsSIFT(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis, const cv::Mat &mask,
+                      const cv::Ptr<cv::FeatureDetector> &instance){
+     // Get SIFT detector
+    cv::Ptr<cv::FeatureDetector> detector = instance.empty() ? getDetector("SIFT") : instance;
     double t = (double)cv::getTickCount();
     // SIFT detector input
     // - (input image, extracted keypoints)
-    detector->detect(img, keypoints);
+    detector->detect(img, keypoints, mask);
     t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    recordStageTime("detector SIFT", 1000 * t / 1.0);
     cout << "SIFT detector with n= " << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
 
     // visualize results
@@ -180,14 +1498,16 @@ void detKeypointsSIFT(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool b
     }
 }
 // Detect keypoints in image using BRISK detector
-void detKeypointsBRISK(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis){
-    // Create BRISK detector
-    cv::Ptr<cv::FeatureDetector> detector = cv::BRISK::create();
+void detKeypointsBRISK(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis, const cv::Mat &mask,
+                       const cv::Ptr<cv::FeatureDetector> &instance){
+    // Get BRISK detector
+    cv::Ptr<cv::FeatureDetector> detector = instance.empty() ? getDetector("BRISK") : instance;
     double t = (double)cv::getTickCount();
     // BRISK detector input
     // - (input image, extracted keypoints)
-    detector->detect(img, keypoints);
+    detector->detect(img, keypoints, mask);
     t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    recordStageTime("detector BRISK", 1000 * t / 1.0);
     cout << "BRISK detector with n= " << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
 
     // visualize results
@@ -202,12 +1522,14 @@ void detKeypointsBRISK(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool
     }
 }
 // Detect keypoints in image using FAST detector
-void detKeypointsFAST(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis){
+void detKeypointsFAST(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis, const cv::Mat &mask,
+                      const cv::Ptr<cv::FeatureDetector> &instance){
+    // Get FAST detector (threshold 70, nonmaxSuppression)
+    cv::Ptr<cv::FeatureDetector> detector = instance.empty() ? getDetector("FAST") : instance;
     double t = (double)cv::getTickCount();
-    // FAST input
-    // - (input image, extracted keypoints, threshold(pixel diff between center and neighbor's), nonmaxSuppression)
-    cv::FAST(img, keypoints, 70, true);
+    detector->detect(img, keypoints, mask);
     t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    recordStageTime("detector FAST", 1000 * t / 1.0);
     cout << "FAST with n= " << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
 
     // visualize results
@@ -221,35 +1543,286 @@ void detKeypointsFAST(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool b
         cv::waitKey(0);
     }
 }
-// Detect keypoints in image using Harris corner detector
-void detKeypointsHarris(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis){
+// Harris detector parameters (shared by the detector and its reference implementation)
+static const int harrisBlockSize = 2;     // orig 2, for every pixel, a blockSize × blockSize neighborhood is considered
+static const int harrisApertureSize = 3;  // aperture parameter for Sobel operator (must be odd)
+static const int harrisMinResponse = 100; // orig 100,minimum value for a corner in the 8bit scaled response matrix
+static const double harrisK = 0.04;       // Harris parameter (see equation for details)
 
-    // Detector parameters
-    int blockSize = 2;     // orig 2, for every pixel, a blockSize × blockSize neighborhood is considered
-    int apertureSize = 3;  // aperture parameter for Sobel operator (must be odd)
-    int minResponse = 100; // orig 100,minimum value for a corner in the 8bit scaled response matrix
-    double k = 0.04;       // Harris parameter (see equation for details)
-
-    double t = (double)cv::getTickCount();
-    // Detect Harris corners and normalize output
-    cv::Mat dst, dst_norm, dst_norm_scaled;
+// Detect Harris corners and normalize output to 0..255
+static void harrisNormalizedResponse(cv::Mat &img, cv::Mat &dst_norm)
+{
+    cv::Mat dst;
     dst = cv::Mat::zeros(img.size(), CV_32FC1);
-    cv::cornerHarris(img, dst, blockSize, apertureSize, k, cv::BORDER_DEFAULT);
+    cv::cornerHarris(img, dst, harrisBlockSize, harrisApertureSize, harrisK, cv::BORDER_DEFAULT);
     cv::normalize(dst, dst_norm, 0, 255, cv::NORM_MINMAX, CV_32FC1, cv::Mat());
-    cv::convertScaleAbs(dst_norm, dst_norm_scaled);
+}
+
+// Suppression neighbourhood of the Harris NMS : two keypoints of size 2*apertureSize overlap (cv::KeyPoint::overlap > 0)
+// if their distance is smaller than their size, so a corner must be the maximum within this disc.
+static cv::Mat harrisNMSKernel()
+{
+    int kptSize = 2 * harrisApertureSize;
+    int radius = kptSize - 1;
+    cv::Mat kernel = cv::Mat::zeros(2 * radius + 1, 2 * radius + 1, CV_8U);
+    for (int dy = -radius; dy <= radius; dy++)
+        for (int dx = -radius; dx <= radius; dx++)
+            kernel.at<uchar>(dy + radius, dx + radius) = (dx * dx + dy * dy < kptSize * kptSize) ? 1 : 0;
+    return kernel;
+}
+
+// Plateau handling of the local-maximum NMS : of several equal maxima only the first one in raster order is kept
+static bool hasEarlierEqualNeighbour(const cv::Mat &response, const cv::Mat &kernel, int i, int j)
+{
+    int radius = kernel.rows / 2;
+    float val = response.at<float>(i, j);
+    for (int dy = -radius; dy <= 0; dy++)
+    {
+        int y = i + dy;
+        if (y < 0)
+            continue;
+        const float *row = response.ptr<float>(y);
+        const uchar *kernelRow = kernel.ptr<uchar>(dy + radius);
+        int dxEnd = (dy == 0) ? -1 : radius;
+        for (int dx = -radius; dx <= dxEnd; dx++)
+        {
+            int x = j + dx;
+            if (x >= 0 && x < response.cols && kernelRow[dx + radius] && row[x] == val)
+                return true;
+        }
+    }
+    return false;
+}
+
+// Border extrapolation as cv::BORDER_REFLECT_101 : gfedcb|abcdefgh|gfedcba
+static inline int reflect101(int p, int len)
+{
+    if (len == 1)
+        return 0;
+    while (p < 0 || p >= len)
+        p = p < 0 ? -p : 2 * len - p - 2;
+    return p;
+}
+
+// Fused Harris response for the image rows [r0, r1) : 3x3 Sobel gradients, gradient products, the blockSize x blockSize
+// box filter and the Harris response are computed in a single pass over the tile, only the response is written out.
+// Borders are handled like cv::cornerHarris with BORDER_DEFAULT. Returns the min. and max. response within the tile.
+static void harrisResponseTile(const cv::Mat &img, cv::Mat &resp, int r0, int r1, float &minR, float &maxR)
+{
+    int rows = img.rows, cols = img.cols;
+    int anchor = harrisBlockSize / 2;                  // box filter anchor (as in cv::boxFilter)
+    int g0 = r0 - anchor;                              // first gradient row needed by the box filter
+    int nG = (r1 - r0) + harrisBlockSize - 1;          // no. of gradient rows needed
+    int ext = cols + harrisBlockSize - 1;              // gradient columns incl. the box filter border
+
+    // gradient products for all rows / columns of the tile incl. box filter border
+    vector<float> dxx(nG * ext), dxy(nG * ext), dyy(nG * ext);
+    for (int gi = 0; gi < nG; gi++)
+    {
+        int y = reflect101(g0 + gi, rows);
+        const uchar *rowUp = img.ptr<uchar>(reflect101(y - 1, rows));
+        const uchar *row = img.ptr<uchar>(y);
+        const uchar *rowDn = img.ptr<uchar>(reflect101(y + 1, rows));
+        float *pxx = &dxx[gi * ext], *pxy = &dxy[gi * ext], *pyy = &dyy[gi * ext];
+        for (int ge = 0; ge < ext; ge++)
+        {
+            int x = ge - anchor, xl, xr;
+            if (x >= 1 && x < cols - 1)
+            {
+                xl = x - 1; xr = x + 1;
+            }
+            else
+            {
+                x = reflect101(x, cols);
+                xl = reflect101(x - 1, cols); xr = reflect101(x + 1, cols);
+            }
+            float dx = (float)((rowUp[xr] + 2 * row[xr] + rowDn[xr]) - (rowUp[xl] + 2 * row[xl] + rowDn[xl]));
+            float dy = (float)((rowDn[xl] + 2 * rowDn[x] + rowDn[xr]) - (rowUp[xl] + 2 * rowUp[x] + rowUp[xr]));
+            pxx[ge] = dx * dx;
+            pxy[ge] = dx * dy;
+            pyy[ge] = dy * dy;
+        }
+    }
+
+    // box filter (vertical, then horizontal) and Harris response
+    vector<float> vxx(ext), vxy(ext), vyy(ext);
+    minR = std::numeric_limits<float>::max();
+    maxR = -std::numeric_limits<float>::max();
+    for (int i = r0; i < r1; i++)
+    {
+        int gi = i - r0;
+        for (int ge = 0; ge < ext; ge++)
+        {
+            float sxx = 0, sxy = 0, syy = 0;
+            for (int o = 0; o < harrisBlockSize; o++)
+            {
+                int idx = (gi + o) * ext + ge;
+                sxx += dxx[idx]; sxy += dxy[idx]; syy += dyy[idx];
+            }
+            vxx[ge] = sxx; vxy[ge] = sxy; vyy[ge] = syy;
+        }
+
+        float *respRow = resp.ptr<float>(i);
+        for (int j = 0; j < cols; j++)
+        {
+            double sxx = 0, sxy = 0, syy = 0;
+            for (int o = 0; o < harrisBlockSize; o++)
+            {
+                sxx += vxx[j + o]; sxy += vxy[j + o]; syy += vyy[j + o];
+            }
+            float r = (float)(sxx * syy - sxy * sxy - harrisK * (sxx + syy) * (sxx + syy));
+            respRow[j] = r;
+            minR = min(minR, r);
+            maxR = max(maxR, r);
+        }
+    }
+}
+
+// Threshold and local-maximum NMS for the rows [r0, r1) of the raw Harris response. The threshold is applied on the
+// response normalized to 0..255 by the global min. / max., neighbours are read across tile borders.
+static void harrisNMSTile(const cv::Mat &resp, const cv::Mat &kernel, const cv::Mat &mask, float minR, float maxR, int r0, int r1,
+                          vector<cv::KeyPoint> &keypoints)
+{
+    float scale = maxR > minR ? 255.0f / (maxR - minR) : 0.0f;
+    int radius = kernel.rows / 2;
+    for (int i = r0; i < r1; i++)
+    {
+        const float *respRow = resp.ptr<float>(i);
+        const uchar *maskRow = mask.empty() ? nullptr : mask.ptr<uchar>(i);
+        for (int j = 0; j < resp.cols; j++)
+        {
+            float val = respRow[j];
+            int response = (int)((val - minR) * scale);
+            if (response <= harrisMinResponse || (maskRow != nullptr && maskRow[j] == 0))
+                continue;
+
+            // keep the pixel if no neighbour is larger and no earlier neighbour (raster order) is equal
+            bool isMax = true;
+            for (int dy = -radius; dy <= radius && isMax; dy++)
+            {
+                int y = i + dy;
+                if (y < 0 || y >= resp.rows)
+                    continue;
+                const float *row = resp.ptr<float>(y);
+                const uchar *kernelRow = kernel.ptr<uchar>(dy + radius);
+                for (int dx = -radius; dx <= radius; dx++)
+                {
+                    int x = j + dx;
+                    if (x < 0 || x >= resp.cols || !kernelRow[dx + radius] || (dx == 0 && dy == 0))
+                        continue;
+                    if (row[x] > val || (row[x] == val && (dy < 0 || (dy == 0 && dx < 0))))
+                    {
+                        isMax = false;
+                        break;
+                    }
+                }
+            }
+
+            if (isMax)
+            {
+                cv::KeyPoint newKeypoint;
+                newKeypoint.pt = cv::Point2f(j, i);
+                newKeypoint.response = response;
+                newKeypoint.size = 2 * harrisApertureSize;
+                keypoints.push_back(newKeypoint);
+            }
+        }
+    }
+}
+
+// Detect keypoints in image using Harris corner detector. The image is split into row tiles which are processed in
+// parallel by a fused kernel (gradients, products, box filter and response in one pass) followed by a tiled
+// threshold + NMS pass. Two passes are needed because the threshold is defined on the globally normalized response.
+// If a mask is given, corners are only reported where the mask is non-zero (the response is normalized over the full image).
+void detKeypointsHarris(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis, const cv::Mat &mask,
+                        const cv::Ptr<cv::FeatureDetector> &instance){
+
+    CV_Assert(img.type() == CV_8UC1 && harrisApertureSize == 3);
+    CV_Assert(mask.empty() || (mask.type() == CV_8UC1 && mask.size() == img.size()));
+
+    double t = (double)cv::getTickCount();
+    int tileRows = 16; // rows per tile, keeps the gradient buffers of a tile in L2 cache
+    int nTiles = (img.rows + tileRows - 1) / tileRows;
+    cv::Mat resp(img.size(), CV_32FC1);
+    vector<float> tileMin(nTiles), tileMax(nTiles);
+    cv::parallel_for_(cv::Range(0, nTiles), [&](const cv::Range &range) {
+        for (int tile = range.start; tile < range.end; tile++)
+            harrisResponseTile(img, resp, tile * tileRows, min(img.rows, (tile + 1) * tileRows), tileMin[tile], tileMax[tile]);
+    });
+    float minR = *std::min_element(tileMin.begin(), tileMin.end());
+    float maxR = *std::max_element(tileMax.begin(), tileMax.end());
 
     // Perform a non-maximum suppression (NMS) in a local neighborhood around each maximum in the Harris response matrix.
-    // Look for prominent corners and instantiate keypoints
+    cv::Mat kernel = harrisNMSKernel();
+    vector<vector<cv::KeyPoint>> tileKeypoints(nTiles);
+    cv::parallel_for_(cv::Range(0, nTiles), [&](const cv::Range &range) {
+        for (int tile = range.start; tile < range.end; tile++)
+            harrisNMSTile(resp, kernel, mask, minR, maxR, tile * tileRows, min(img.rows, (tile + 1) * tileRows), tileKeypoints[tile]);
+    });
+    for (auto it = tileKeypoints.begin(); it != tileKeypoints.end(); ++it)
+        keypoints.insert(keypoints.end(), it->begin(), it->end());
+    
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    recordStageTime("detector HARRIS", 1000 * t / 1.0);
+    cout << "Harris Corner detection with non-maximum suppression(NMS) n=" << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+
+    // visualize results
+    if (bVis)
+    {
+        cv::Mat visImage = img.clone();
+        cv::drawKeypoints(img, keypoints, visImage, cv::Scalar::all(-1), cv::DrawMatchesFlags::DRAW_RICH_KEYPOINTS);
+        string windowName = "Harris Corner Detector with non-maximum suppression(NMS) Results";
+        cv::namedWindow(windowName, 2);
+        imshow(windowName, visImage);
+        cv::waitKey(0);
+    }
+}
+
+// Harris detector based on cv::cornerHarris + cv::normalize and a dilate-and-compare local-maximum NMS. Used as
+// reference for the fused, tiled detKeypointsHarris.
+void detKeypointsHarrisUnfused(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img)
+{
+    cv::Mat dst_norm;
+    harrisNormalizedResponse(img, dst_norm);
+
+    // A pixel is a local maximum if it equals the grey-level dilation of the response over the suppression disc
+    cv::Mat kernel = harrisNMSKernel();
+    cv::Mat dst_max;
+    cv::dilate(dst_norm, dst_max, kernel);
+    for (int i=0; i<dst_norm.rows; i++){
+        const float *respRow = dst_norm.ptr<float>(i);
+        const float *maxRow = dst_max.ptr<float>(i);
+        for(int j=0; j<dst_norm.cols; j++){
+            int response = (int)respRow[j];
+            // only store points above a threshold which are maximal in their neighborhood
+            if(response > harrisMinResponse && respRow[j] == maxRow[j] && !hasEarlierEqualNeighbour(dst_norm, kernel, i, j)){
+                cv::KeyPoint newKeypoint;
+                newKeypoint.pt = cv::Point2f(j,i);
+                newKeypoint.response = response;
+                newKeypoint.size = 2*harrisApertureSize;
+                keypoints.push_back(newKeypoint);
+            }
+        }
+    }
+}
+
+// Reference Harris detector with the original overlap based NMS, every candidate is compared with all keypoints accepted
+// so far (O(n²) in the number of corners). Only used to validate and benchmark detKeypointsHarris.
+void detKeypointsHarrisOverlapNMS(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img)
+{
+    cv::Mat dst_norm;
+    harrisNormalizedResponse(img, dst_norm);
+
     double maxOverlap = 0.0; // max. permissible overlap between two features in %, used during non-maxima suppression
     for (int i=0; i<dst_norm.rows; i++){
         for(int j=0; j<dst_norm.cols; j++){
             int response = (int)dst_norm.at<float>(i,j);
             // only store points above a threshold
-            if(response > minResponse){
+            if(response > harrisMinResponse){
                 cv::KeyPoint newKeypoint;
                 newKeypoint.pt = cv::Point2f(j,i);
                 newKeypoint.response = response;
-                newKeypoint.size = 2*apertureSize;
+                newKeypoint.size = 2*harrisApertureSize;
 
                 // perform non-maximum suppression (NMS) in local neighbourhood around new key point
                 bool overlapFlag = false;
@@ -268,32 +1841,85 @@ void detKeypointsHarris(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool
                 if(!overlapFlag)                        // only add new key point if no overlap has been found in previous NMS
                     keypoints.push_back(newKeypoint);   // store new keypoint in dynamic list
             }
- 
         }
     }
-    
-    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    cout << "Harris Corner detection with non-maximum suppression(NMS) n=" << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+}
 
-    // visualize results
-    if (bVis)
+// Count keypoints of kptsTest which lie within maxDist pixels of a keypoint in kptsRef
+static int countCoincidingKeypoints(const vector<cv::KeyPoint> &kptsRef, const vector<cv::KeyPoint> &kptsTest, cv::Size imgSize, int maxDist)
+{
+    cv::Mat refMask = cv::Mat::zeros(imgSize, CV_8U);
+    for (auto it = kptsRef.begin(); it != kptsRef.end(); ++it)
+        cv::circle(refMask, cv::Point(cvRound(it->pt.x), cvRound(it->pt.y)), maxDist, cv::Scalar(255), -1);
+
+    int count = 0;
+    for (auto it = kptsTest.begin(); it != kptsTest.end(); ++it)
+        if (refMask.at<uchar>(cvRound(it->pt.y), cvRound(it->pt.x)))
+            count++;
+    return count;
+}
+
+// Benchmark the Harris variants on a set of grayscale frames : original overlap NMS, cornerHarris + local-maximum NMS and
+// the fused tiled kernel. Keypoints of the fused kernel are compared with the unfused one within a 1 pixel tolerance, the
+// benchmark fails (cv::Exception) if a frame misses the acceptance limits.
+void benchmarkHarrisNMS(std::vector<cv::Mat> &images)
+{
+    // acceptance per frame : share of local-max NMS keypoints identical to overlap NMS (the greedy overlap NMS depends on
+    // the scan order, 89 - 98 % on the KITTI frames), share of fused keypoints within 1px of local-max NMS and the relative
+    // count difference (rounding differences of the response only)
+    const double minSameShare = 0.85, minTolShare = 0.98, maxCountDiff = 0.02;
+    double tRefSum = 0, tUnfusedSum = 0, tNewSum = 0;
+    int nRefSum = 0, nUnfusedSum = 0, nNewSum = 0, nSameSum = 0, nTolSum = 0;
+    cout << "============================================="<<endl;
+    cout << "Harris benchmark (overlap NMS / local-maximum NMS / fused tiled kernel)" << endl;
+    for (size_t i = 0; i < images.size(); ++i)
     {
-        cv::Mat visImage = img.clone();
-        cv::drawKeypoints(img, keypoints, visImage, cv::Scalar::all(-1), cv::DrawMatchesFlags::DRAW_RICH_KEYPOINTS);
-        string windowName = "Harris Corner Detector with non-maximum suppression(NMS) Results";
-        cv::namedWindow(windowName, 2);
-        imshow(windowName, visImage);
-        cv::waitKey(0);
+        vector<cv::KeyPoint> kptsRef, kptsUnfused, kptsNew;
+        double t = (double)cv::getTickCount();
+        detKeypointsHarrisOverlapNMS(kptsRef, images[i]);
+        double tRef = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+        t = (double)cv::getTickCount();
+        detKeypointsHarrisUnfused(kptsUnfused, images[i]);
+        double tUnfused = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+        t = (double)cv::getTickCount();
+        detKeypointsHarris(kptsNew, images[i], false);
+        double tNew = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+        int nSame = countCoincidingKeypoints(kptsRef, kptsUnfused, images[i].size(), 0);
+        int nTol = countCoincidingKeypoints(kptsUnfused, kptsNew, images[i].size(), 1);
+        cout << "frame " << i << " : overlap NMS n=" << kptsRef.size() << " in " << 1000 * tRef << " ms, local-max NMS n="
+             << kptsUnfused.size() << " in " << 1000 * tUnfused << " ms (identical to overlap NMS " << nSame << "), fused n="
+             << kptsNew.size() << " in " << 1000 * tNew << " ms (within 1px of local-max NMS " << nTol << ")" << endl;
+        CV_Assert(nSame >= minSameShare * kptsRef.size());
+        CV_Assert(nTol >= minTolShare * kptsNew.size() &&
+                  abs((int)kptsNew.size() - (int)kptsUnfused.size()) <= max(2.0, maxCountDiff * kptsUnfused.size()));
+
+        tRefSum += tRef; tUnfusedSum += tUnfused; tNewSum += tNew;
+        nRefSum += kptsRef.size(); nUnfusedSum += kptsUnfused.size(); nNewSum += kptsNew.size();
+        nSameSum += nSame; nTolSum += nTol;
     }
+    if (!images.empty())
+    {
+        cout << "total : overlap NMS n=" << nRefSum << " avg " << 1000 * tRefSum / images.size() << " ms, local-max NMS n="
+             << nUnfusedSum << " avg " << 1000 * tUnfusedSum / images.size() << " ms, fused n=" << nNewSum << " avg "
+             << 1000 * tNewSum / images.size() << " ms" << endl;
+        cout << "local-max NMS identical to overlap NMS : " << 100.0 * nSameSum / max(1, nRefSum) << " %, fused within 1px of local-max NMS : "
+             << 100.0 * nTolSum / max(1, nNewSum) << " %" << endl;
+    }
+    cout << "============================================="<<endl;
 }
+
 // Detect keypoints in image using the traditional Shi-Thomasi detector
-void detKeypointsShiTomasi(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis)
+void detKeypointsShiTomasi(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis, const cv::Mat &mask,
+                           const cv::Ptr<cv::FeatureDetector> &instance)
 {
     // compute detector parameters based on image size
     int blockSize = 4;       //  size of an average block for computing a derivative covariation matrix over each pixel neighborhood
     double maxOverlap = 0.0; // max. permissible overlap between two features in %
     double minDistance = (1.0 - maxOverlap) * blockSize;
-    int maxCorners = img.rows * img.cols / max(1.0, minDistance); // max. num. of keypoints
+    int maxCorners = 0; // max. num. of keypoints (0 : no limit, corners are limited afterwards by the caller if needed)
 
     double qualityLevel = 0.01; // minimal accepted quality of image corners
     double k = 0.04;
@@ -301,18 +1927,20 @@ void detKeypointsShiTomasi(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool b
     // Apply corner detection
     double t = (double)cv::getTickCount();
     vector<cv::Point2f> corners;
-    cv::goodFeaturesToTrack(img, corners, maxCorners, qualityLevel, minDistance, cv::Mat(), blockSize, false, k);
+    cv::goodFeaturesToTrack(img, corners, maxCorners, qualityLevel, minDistance, mask, blockSize, false, k);
 
-    // add corners to result vector
+    // add corners to result vector, corners are sorted by descending quality which is kept as rank based response
     for (auto it = corners.begin(); it != corners.end(); ++it)
     {
 
         cv::KeyPoint newKeyPoint;
         newKeyPoint.pt = cv::Point2f((*it).x, (*it).y);
         newKeyPoint.size = blockSize;
+        newKeyPoint.response = (float)(corners.end() - it);
         keypoints.push_back(newKeyPoint);
     }
     t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    recordStageTime("detector SHITOMASI", 1000 * t / 1.0);
     cout << "Shi-Tomasi detection with n=" << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
 
     // visualize results
@@ -325,4 +1953,4 @@ void detKeypointsShiTomasi(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool b
         imshow(windowName, visImage);
         cv::waitKey(0);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,650 @@
+
+#include <iostream>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#include <opencv2/features2d.hpp>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define HAMMING_X86_SIMD 1
+// AVX-512 VPOPCNTDQ intrinsics need gcc >= 7, AVX-512 VNNI gcc >= 8 (clang reports __GNUC__ 4 and has both)
+#if defined(__clang__) || __GNUC__ >= 7
+#define HAMMING_X86_VPOPCNTDQ 1
+#endif
+#if defined(__clang__) || __GNUC__ >= 8
+#define L2U8_X86_VNNI 1
+#endif
+#endif
+
+#include "matchingKernels.hpp"
+
+using namespace std;
+
+// block sizes of the brute-force kernel : a train tile of 256 descriptors (16 KB at 64 bytes) stays in L1 while all queries
+// of a query block are compared against it, query blocks are the unit of parallel work
+static const int hammingTrainTile = 256;
+static const int hammingQueryBlock = 64;
+
+// best and second best distance of every query of a block, updated tile by tile
+struct Knn2Block {
+    int best1[hammingQueryBlock];
+    int best2[hammingQueryBlock];
+    int idx1[hammingQueryBlock];
+};
+
+// Scalar kernel for any descriptor length : 64-bit popcount over whole words and a byte loop for the rest
+static void knn2BlockScalar(const cv::Mat &query, const cv::Mat &train, int q0, int q1, Knn2Block &block)
+{
+    int bytes = query.cols, words = bytes / 8;
+    for (int t0 = 0; t0 < train.rows; t0 += hammingTrainTile)
+    {
+        int t1 = min(train.rows, t0 + hammingTrainTile);
+        for (int q = q0; q < q1; ++q)
+        {
+            const uchar *qd = query.ptr<uchar>(q);
+            int b1 = block.best1[q - q0], b2 = block.best2[q - q0], i1 = block.idx1[q - q0];
+            for (int t = t0; t < t1; ++t)
+            {
+                const uchar *td = train.ptr<uchar>(t);
+                int d = 0;
+                for (int w = 0; w < words; ++w)
+                {
+                    uint64_t a, b;
+                    memcpy(&a, qd + 8 * w, 8);
+                    memcpy(&b, td + 8 * w, 8);
+                    d += __builtin_popcountll(a ^ b);
+                }
+                for (int k = 8 * words; k < bytes; ++k)
+                    d += __builtin_popcount(qd[k] ^ td[k]);
+                if (d < b1) { b2 = b1; b1 = d; i1 = t; }
+                else if (d < b2) { b2 = d; }
+            }
+            block.best1[q - q0] = b1; block.best2[q - q0] = b2; block.idx1[q - q0] = i1;
+        }
+    }
+}
+
+#ifdef HAMMING_X86_SIMD
+// AVX2 : popcount of 32 bytes with a nibble lookup table (vpshufb) and a horizontal byte sum (vpsadbw)
+__attribute__((target("avx2"))) static inline __m256i popcount256(__m256i v)
+{
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowMask = _mm256_set1_epi8(0x0f);
+    __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, lowMask));
+    __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), lowMask));
+    return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()); // 4 x 64-bit partial counts
+}
+
+template <int BYTES>
+__attribute__((target("avx2"))) static inline int hammingAVX2(const uchar *a, const uchar *b)
+{
+    __m256i sum = popcount256(_mm256_xor_si256(_mm256_loadu_si256((const __m256i *)a), _mm256_loadu_si256((const __m256i *)b)));
+    if (BYTES == 64)
+        sum = _mm256_add_epi64(sum, popcount256(_mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + 32)),
+                                                                 _mm256_loadu_si256((const __m256i *)(b + 32)))));
+    __m128i s = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    return (int)(_mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1));
+}
+
+template <int BYTES>
+__attribute__((target("avx2"))) static void knn2BlockAVX2(const cv::Mat &query, const cv::Mat &train, int q0, int q1, Knn2Block &block)
+{
+    for (int t0 = 0; t0 < train.rows; t0 += hammingTrainTile)
+    {
+        int t1 = min(train.rows, t0 + hammingTrainTile);
+        for (int q = q0; q < q1; ++q)
+        {
+            const uchar *qd = query.ptr<uchar>(q);
+            int b1 = block.best1[q - q0], b2 = block.best2[q - q0], i1 = block.idx1[q - q0];
+            for (int t = t0; t < t1; ++t)
+            {
+                int d = hammingAVX2<BYTES>(qd, train.ptr<uchar>(t));
+                if (d < b1) { b2 = b1; b1 = d; i1 = t; }
+                else if (d < b2) { b2 = d; }
+            }
+            block.best1[q - q0] = b1; block.best2[q - q0] = b2; block.idx1[q - q0] = i1;
+        }
+    }
+}
+
+#ifdef HAMMING_X86_VPOPCNTDQ
+// AVX-512 VPOPCNTDQ : one 512-bit popcount per descriptor pair, descriptors shorter than 64 bytes (16 byte BRIEF, compact
+// AKAZE / FREAK, 32 byte ORB) use a masked byte load
+__attribute__((target("avx512f,avx512bw,avx512vpopcntdq"))) static void knn2BlockAVX512(const cv::Mat &query, const cv::Mat &train, int q0,
+                                                                                         int q1, Knn2Block &block)
+{
+    int bytes = query.cols;
+    const __mmask64 loadMask = bytes == 64 ? ~0ULL : (1ULL << bytes) - 1;
+    for (int t0 = 0; t0 < train.rows; t0 += hammingTrainTile)
+    {
+        int t1 = min(train.rows, t0 + hammingTrainTile);
+        for (int q = q0; q < q1; ++q)
+        {
+            __m512i qv = _mm512_maskz_loadu_epi8(loadMask, query.ptr<uchar>(q));
+            int b1 = block.best1[q - q0], b2 = block.best2[q - q0], i1 = block.idx1[q - q0];
+            for (int t = t0; t < t1; ++t)
+            {
+                __m512i tv = _mm512_maskz_loadu_epi8(loadMask, train.ptr<uchar>(t));
+                int d = (int)_mm512_reduce_add_epi64(_mm512_popcnt_epi64(_mm512_xor_si512(qv, tv)));
+                if (d < b1) { b2 = b1; b1 = d; i1 = t; }
+                else if (d < b2) { b2 = d; }
+            }
+            block.best1[q - q0] = b1; block.best2[q - q0] = b2; block.idx1[q - q0] = i1;
+        }
+    }
+}
+#endif
+#endif
+
+typedef void (*Knn2BlockFn)(const cv::Mat &query, const cv::Mat &train, int q0, int q1, Knn2Block &block);
+
+// Select the kernel for the descriptor length by the features of the CPU (AVX-512 VPOPCNTDQ up to 64 bytes, AVX2 for 32
+// and 64 bytes, scalar)
+static Knn2BlockFn selectKnn2Kernel(int bytes, string *name)
+{
+#ifdef HAMMING_X86_SIMD
+#ifdef HAMMING_X86_VPOPCNTDQ
+    static bool hasAVX512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+                            __builtin_cpu_supports("avx512vpopcntdq");
+    if (hasAVX512 && bytes <= 64)
+    {
+        if (name) *name = "AVX-512 VPOPCNTDQ";
+        return knn2BlockAVX512;
+    }
+#endif
+    static bool hasAVX2 = __builtin_cpu_supports("avx2");
+    if (hasAVX2 && (bytes == 32 || bytes == 64))
+    {
+        if (name) *name = "AVX2 nibble LUT";
+        return bytes == 32 ? knn2BlockAVX2<32> : knn2BlockAVX2<64>;
+    }
+#endif
+    if (name) *name = "scalar popcount";
+    return knn2BlockScalar;
+}
+
+// Name of the kernel used for 32 byte descriptors on this CPU
+string hammingKernelName()
+{
+    string name;
+    selectKnn2Kernel(32, &name);
+    return name;
+}
+
+// Brute-force kNN-2 matching of binary descriptors with the Hamming distance, exact like BFMatcher::knnMatch(k = 2). Query
+// blocks run in parallel, the ratio test (best < ratio * second best) is applied in the same pass, ratio <= 0 keeps the
+// nearest neighbour of every query. Queries with a single train descriptor have no second neighbour and are kept.
+// Matches use queryIdx = query row and trainIdx = train row.
+void matchHammingKnn2(const cv::Mat &query, const cv::Mat &train, std::vector<cv::DMatch> &matches, float ratio)
+{
+    matches.clear();
+    if (query.empty() || train.empty())
+        return;
+    if (query.type() != CV_8U || train.type() != CV_8U || query.cols != train.cols)
+        CV_Error(cv::Error::StsBadArg, "Hamming matching needs binary descriptors (CV_8U) of equal length");
+
+    Knn2BlockFn kernel = selectKnn2Kernel(query.cols, nullptr);
+    int nBlocks = (query.rows + hammingQueryBlock - 1) / hammingQueryBlock;
+    vector<cv::DMatch> blockMatches(query.rows);
+    vector<uchar> accepted(query.rows, 0);
+
+    cv::parallel_for_(cv::Range(0, nBlocks), [&](const cv::Range &range) {
+        Knn2Block block;
+        for (int b = range.start; b < range.end; ++b)
+        {
+            int q0 = b * hammingQueryBlock, q1 = min(query.rows, q0 + hammingQueryBlock);
+            for (int i = 0; i < q1 - q0; ++i)
+            {
+                block.best1[i] = block.best2[i] = INT_MAX;
+                block.idx1[i] = -1;
+            }
+            kernel(query, train, q0, q1, block);
+            for (int q = q0; q < q1; ++q)
+            {
+                int b1 = block.best1[q - q0], b2 = block.best2[q - q0];
+                accepted[q] = ratio <= 0 || b2 == INT_MAX || b1 < ratio * b2;
+                blockMatches[q] = cv::DMatch(q, block.idx1[q - q0], (float)b1);
+            }
+        }
+    });
+
+    for (int q = 0; q < query.rows; ++q)
+        if (accepted[q])
+            matches.push_back(blockMatches[q]);
+}
+
+// Compare the kernel with BFMatcher(NORM_HAMMING)::knnMatch on random descriptors of the configurable lengths (16, 32, 61
+// (full AKAZE) and 64 bytes), results and time
+void benchmarkHammingKnn2(int nQuery, int nTrain)
+{
+    cout << "============================================="<<endl;
+    cout << "Hamming kNN-2 benchmark (" << nQuery << " x " << nTrain << ", kernel : " << hammingKernelName() << ")" << endl;
+    int byteOptions[] = {16, 32, 61, 64};
+    for (int o = 0; o < 4; ++o)
+    {
+        int bytes = byteOptions[o];
+        cv::Mat query(nQuery, bytes, CV_8U), train(nTrain, bytes, CV_8U);
+        cv::randu(query, 0, 256);
+        cv::randu(train, 0, 256);
+        float ratio = 0.8f;
+
+        double t = (double)cv::getTickCount();
+        vector<cv::DMatch> kernelMatches;
+        matchHammingKnn2(query, train, kernelMatches, ratio);
+        double tKernel = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+        t = (double)cv::getTickCount();
+        vector<vector<cv::DMatch>> knnMatches;
+        cv::BFMatcher(cv::NORM_HAMMING).knnMatch(query, train, knnMatches, 2);
+        vector<cv::DMatch> refMatches;
+        for (auto it = knnMatches.begin(); it != knnMatches.end(); ++it)
+            if (!it->empty() && (it->size() < 2 || (*it)[0].distance < ratio * (*it)[1].distance))
+                refMatches.push_back((*it)[0]);
+        double tRef = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+        // nearest neighbours may differ on equal distances, so compare query and distance
+        int nSame = 0;
+        for (size_t i = 0, j = 0; i < kernelMatches.size() && j < refMatches.size();)
+        {
+            if (kernelMatches[i].queryIdx < refMatches[j].queryIdx) ++i;
+            else if (kernelMatches[i].queryIdx > refMatches[j].queryIdx) ++j;
+            else { nSame += kernelMatches[i].distance == refMatches[j].distance; ++i; ++j; }
+        }
+        cout << bytes << " bytes : kernel n=" << kernelMatches.size() << " in " << 1000 * tKernel << " ms, BFMatcher n="
+             << refMatches.size() << " in " << 1000 * tRef << " ms, identical " << nSame << endl;
+    }
+    cout << "============================================="<<endl;
+}
+
+// multi-index hashing : 256-bit descriptors are split into mihTables substrings of 16 bits
+static const int mihTables = 16;
+static const int mihKeys = 1 << 16;
+
+// 16-bit substring s of a 32 byte descriptor
+static inline int mihKey(const uchar *desc, int s)
+{
+    return desc[2 * s] | (desc[2 * s + 1] << 8);
+}
+
+static inline int hamming256(const uchar *a, const uchar *b)
+{
+    int d = 0;
+    for (int w = 0; w < 4; ++w)
+    {
+        uint64_t x, y;
+        memcpy(&x, a + 8 * w, 8);
+        memcpy(&y, b + 8 * w, 8);
+        d += __builtin_popcountll(x ^ y);
+    }
+    return d;
+}
+
+// All 16-bit masks grouped by their no. of set bits, used to probe the buckets at substring distance r
+static const vector<vector<uint16_t>> &mihMasksByWeight()
+{
+    static vector<vector<uint16_t>> masks;
+    static cv::Mutex masksMutex;
+    cv::AutoLock lock(masksMutex);
+    if (masks.empty())
+    {
+        masks.resize(17);
+        for (int m = 0; m < mihKeys; ++m)
+            masks[__builtin_popcount(m)].push_back((uint16_t)m);
+    }
+    return masks;
+}
+
+// Build the hash tables over 256-bit descriptors (one counting sort per substring)
+void buildMihIndex(MihIndex &index, const cv::Mat &descriptors)
+{
+    if (!descriptors.empty() && (descriptors.type() != CV_8U || descriptors.cols != 32))
+        CV_Error(cv::Error::StsBadArg, "multi-index hashing needs 256-bit binary descriptors (32 bytes, CV_8U)");
+
+    int n = descriptors.rows;
+    index.descriptors = descriptors;
+    index.bucketStart.assign(mihTables * (mihKeys + 1), 0);
+    index.ids.resize(mihTables * n);
+    for (int s = 0; s < mihTables; ++s)
+    {
+        int *start = &index.bucketStart[s * (mihKeys + 1)];
+        for (int i = 0; i < n; ++i)
+            start[mihKey(descriptors.ptr<uchar>(i), s) + 1]++;
+        for (int key = 0; key < mihKeys; ++key)
+            start[key + 1] += start[key];
+
+        vector<int> bucketFill(start, start + mihKeys);
+        int *ids = &index.ids[s * n];
+        for (int i = 0; i < n; ++i)
+            ids[bucketFill[mihKey(descriptors.ptr<uchar>(i), s)]++] = i;
+    }
+}
+
+// Exact kNN-2 search in the multi-index : the substring search radius r grows table by table. Before table s is probed at
+// radius r, every descriptor closer than 16 * r + s has been found (pigeonhole principle), so the search stops as soon as
+// the second best distance is below that bound. Once probing a radius costs more lookups than there are descriptors, the
+// rest is scanned linearly. Ties are broken by the lower index, so the result is identical to brute force (same best
+// index, best and second best distance). The ratio test is applied like in matchHammingKnn2.
+void matchMihKnn2(const MihIndex &index, const cv::Mat &query, std::vector<cv::DMatch> &matches, float ratio)
+{
+    matches.clear();
+    int n = index.descriptors.rows;
+    if (query.empty() || n == 0)
+        return;
+    if (query.type() != CV_8U || query.cols != 32)
+        CV_Error(cv::Error::StsBadArg, "multi-index hashing needs 256-bit binary descriptors (32 bytes, CV_8U)");
+
+    const vector<vector<uint16_t>> &masks = mihMasksByWeight();
+    vector<cv::DMatch> queryMatches(query.rows);
+    vector<uchar> accepted(query.rows, 0);
+
+    cv::parallel_for_(cv::Range(0, query.rows), [&](const cv::Range &range) {
+        vector<int> visited(n, -1); // query that last reached a descriptor, avoids duplicate distance computations
+        for (int q = range.start; q < range.end; ++q)
+        {
+            const uchar *qd = query.ptr<uchar>(q);
+            int d1 = INT_MAX, d2 = INT_MAX, i1 = -1, i2 = -1;
+            auto update = [&](int id) {
+                visited[id] = q;
+                int d = hamming256(qd, index.descriptors.ptr<uchar>(id));
+                if (d < d1 || (d == d1 && id < i1)) { d2 = d1; i2 = i1; d1 = d; i1 = id; }
+                else if (d < d2 || (d == d2 && id < i2)) { d2 = d; i2 = id; }
+            };
+
+            bool bDone = false;
+            for (int r = 0; r <= 16 && !bDone; ++r)
+            {
+                for (int s = 0; s < mihTables && !bDone; ++s)
+                {
+                    if (d2 < mihTables * r + s)
+                    {
+                        bDone = true;
+                    }
+                    else if ((int)masks[r].size() > n)
+                    { // probing is more expensive than a scan of the remaining descriptors
+                        for (int id = 0; id < n; ++id)
+                            if (visited[id] != q)
+                                update(id);
+                        bDone = true;
+                    }
+                    else
+                    {
+                        const int *start = &index.bucketStart[s * (mihKeys + 1)];
+                        const int *ids = &index.ids[s * n];
+                        int key = mihKey(qd, s);
+                        for (auto m = masks[r].begin(); m != masks[r].end(); ++m)
+                        {
+                            int bucket = key ^ *m;
+                            for (int k = start[bucket]; k < start[bucket + 1]; ++k)
+                                if (visited[ids[k]] != q)
+                                    update(ids[k]);
+                        }
+                    }
+                }
+            }
+
+            accepted[q] = ratio <= 0 || d2 == INT_MAX || d1 < ratio * d2;
+            queryMatches[q] = cv::DMatch(q, i1, (float)d1);
+        }
+    });
+
+    for (int q = 0; q < query.rows; ++q)
+        if (accepted[q])
+            matches.push_back(queryMatches[q]);
+}
+
+// Compare multi-index hashing with the brute-force kernel on random 256-bit descriptors. Every query is a train descriptor
+// with nFlippedBits random bit flips, so it has a close neighbour like a keypoint tracked between frames.
+void benchmarkMih(int nQuery, int nTrain, int nFlippedBits)
+{
+    cv::Mat train(nTrain, 32, CV_8U), query(nQuery, 32, CV_8U);
+    cv::randu(train, 0, 256);
+    cv::RNG rng(0x5EED);
+    for (int q = 0; q < nQuery; ++q)
+    {
+        train.row(rng.uniform(0, nTrain)).copyTo(query.row(q));
+        for (int f = 0; f < nFlippedBits; ++f)
+        {
+            int bit = rng.uniform(0, 256);
+            query.at<uchar>(q, bit / 8) ^= (uchar)(1 << (bit % 8));
+        }
+    }
+
+    double t = (double)cv::getTickCount();
+    MihIndex index;
+    buildMihIndex(index, train);
+    double tBuild = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+    t = (double)cv::getTickCount();
+    vector<cv::DMatch> mihMatches;
+    matchMihKnn2(index, query, mihMatches, 0.8f);
+    double tMih = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+    t = (double)cv::getTickCount();
+    vector<cv::DMatch> bfMatches;
+    matchHammingKnn2(query, train, bfMatches, 0.8f);
+    double tBF = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+    int nSame = 0;
+    for (size_t i = 0; i < min(mihMatches.size(), bfMatches.size()); ++i)
+        nSame += mihMatches[i].queryIdx == bfMatches[i].queryIdx && mihMatches[i].trainIdx == bfMatches[i].trainIdx &&
+                 mihMatches[i].distance == bfMatches[i].distance;
+    cout << "============================================="<<endl;
+    cout << "MIH benchmark (" << nQuery << " x " << nTrain << ", " << nFlippedBits << " flipped bits) : build " << 1000 * tBuild
+         << " ms, query " << 1000 * tMih << " ms, n=" << mihMatches.size() << ", brute force " << 1000 * tBF << " ms, n="
+         << bfMatches.size() << ", identical " << nSame << endl;
+    cout << "============================================="<<endl;
+}
+
+// best and second best squared L2 distance of every query of a block, both indices are kept for the float re-ranking
+struct L2Knn2Block {
+    int best1[hammingQueryBlock];
+    int best2[hammingQueryBlock];
+    int idx1[hammingQueryBlock];
+    int idx2[hammingQueryBlock];
+};
+
+// Scalar kernel for any descriptor length, the squared distance of 128 uint8 values fits into an int (128 * 255^2)
+static void l2Knn2BlockScalar(const cv::Mat &query, const cv::Mat &train, int q0, int q1, L2Knn2Block &block)
+{
+    int dims = query.cols;
+    for (int t0 = 0; t0 < train.rows; t0 += hammingTrainTile)
+    {
+        int t1 = min(train.rows, t0 + hammingTrainTile);
+        for (int q = q0; q < q1; ++q)
+        {
+            const uchar *qd = query.ptr<uchar>(q);
+            int b1 = block.best1[q - q0], b2 = block.best2[q - q0], i1 = block.idx1[q - q0], i2 = block.idx2[q - q0];
+            for (int t = t0; t < t1; ++t)
+            {
+                const uchar *td = train.ptr<uchar>(t);
+                int d = 0;
+                for (int k = 0; k < dims; ++k)
+                {
+                    int diff = (int)qd[k] - (int)td[k];
+                    d += diff * diff;
+                }
+                if (d < b1) { b2 = b1; i2 = i1; b1 = d; i1 = t; }
+                else if (d < b2) { b2 = d; i2 = t; }
+            }
+            block.best1[q - q0] = b1; block.best2[q - q0] = b2; block.idx1[q - q0] = i1; block.idx2[q - q0] = i2;
+        }
+    }
+}
+
+#ifdef HAMMING_X86_SIMD
+// AVX2 : 16 values per step are widened to int16, the differences are squared and summed pairwise into int32 (vpmaddwd).
+// pmaddubsw does not fit here, the squared difference of two uint8 values overflows its int16 result.
+__attribute__((target("avx2"))) static inline int l2U8AVX2(const uchar *a, const uchar *b, int dims)
+{
+    __m256i sum = _mm256_setzero_si256();
+    for (int k = 0; k < dims; k += 16)
+    {
+        __m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(a + k)));
+        __m256i vb = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(b + k)));
+        __m256i diff = _mm256_sub_epi16(va, vb);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(diff, diff));
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+    return _mm_cvtsi128_si32(s);
+}
+
+__attribute__((target("avx2"))) static void l2Knn2BlockAVX2(const cv::Mat &query, const cv::Mat &train, int q0, int q1, L2Knn2Block &block)
+{
+    int dims = query.cols;
+    for (int t0 = 0; t0 < train.rows; t0 += hammingTrainTile)
+    {
+        int t1 = min(train.rows, t0 + hammingTrainTile);
+        for (int q = q0; q < q1; ++q)
+        {
+            const uchar *qd = query.ptr<uchar>(q);
+            int b1 = block.best1[q - q0], b2 = block.best2[q - q0], i1 = block.idx1[q - q0], i2 = block.idx2[q - q0];
+            for (int t = t0; t < t1; ++t)
+            {
+                int d = l2U8AVX2(qd, train.ptr<uchar>(t), dims);
+                if (d < b1) { b2 = b1; i2 = i1; b1 = d; i1 = t; }
+                else if (d < b2) { b2 = d; i2 = t; }
+            }
+            block.best1[q - q0] = b1; block.best2[q - q0] = b2; block.idx1[q - q0] = i1; block.idx2[q - q0] = i2;
+        }
+    }
+}
+
+#ifdef L2U8_X86_VNNI
+// AVX-512 VNNI : 32 values per step, square and accumulate in one instruction (vpdpwssd)
+__attribute__((target("avx512f,avx512bw,avx512vnni"))) static void l2Knn2BlockVNNI(const cv::Mat &query, const cv::Mat &train, int q0,
+                                                                                  int q1, L2Knn2Block &block)
+{
+    int dims = query.cols;
+    for (int t0 = 0; t0 < train.rows; t0 += hammingTrainTile)
+    {
+        int t1 = min(train.rows, t0 + hammingTrainTile);
+        for (int q = q0; q < q1; ++q)
+        {
+            const uchar *qd = query.ptr<uchar>(q);
+            int b1 = block.best1[q - q0], b2 = block.best2[q - q0], i1 = block.idx1[q - q0], i2 = block.idx2[q - q0];
+            for (int t = t0; t < t1; ++t)
+            {
+                const uchar *td = train.ptr<uchar>(t);
+                __m512i sum = _mm512_setzero_si512();
+                for (int k = 0; k < dims; k += 32)
+                {
+                    __m512i diff = _mm512_sub_epi16(_mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(qd + k))),
+                                                    _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(td + k))));
+                    sum = _mm512_dpwssd_epi32(sum, diff, diff);
+                }
+                int d = _mm512_reduce_add_epi32(sum);
+                if (d < b1) { b2 = b1; i2 = i1; b1 = d; i1 = t; }
+                else if (d < b2) { b2 = d; i2 = t; }
+            }
+            block.best1[q - q0] = b1; block.best2[q - q0] = b2; block.idx1[q - q0] = i1; block.idx2[q - q0] = i2;
+        }
+    }
+}
+#endif
+#endif
+
+typedef void (*L2Knn2BlockFn)(const cv::Mat &query, const cv::Mat &train, int q0, int q1, L2Knn2Block &block);
+
+// Select the integer L2 kernel for the descriptor length by the features of the CPU (AVX-512 VNNI, AVX2, scalar)
+static L2Knn2BlockFn selectL2Knn2Kernel(int dims, string *name)
+{
+#ifdef HAMMING_X86_SIMD
+#ifdef L2U8_X86_VNNI
+    static bool hasVNNI = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vnni");
+    if (hasVNNI && dims % 32 == 0)
+    {
+        if (name) *name = "AVX-512 VNNI";
+        return l2Knn2BlockVNNI;
+    }
+#endif
+    static bool hasAVX2 = __builtin_cpu_supports("avx2");
+    if (hasAVX2 && dims % 16 == 0)
+    {
+        if (name) *name = "AVX2 madd";
+        return l2Knn2BlockAVX2;
+    }
+#endif
+    if (name) *name = "scalar";
+    return l2Knn2BlockScalar;
+}
+
+// Name of the integer L2 kernel used for 128-d descriptors on this CPU
+string l2U8KernelName()
+{
+    string name;
+    selectL2Knn2Kernel(128, &name);
+    return name;
+}
+
+// Quantize float descriptors to uint8 (rounded and saturated), OpenCV's SIFT values are already integers in 0 .. 255
+void quantizeDescriptors(const cv::Mat &descriptors, cv::Mat &quantized)
+{
+    descriptors.convertTo(quantized, CV_8U);
+}
+
+// Brute-force kNN-2 matching of uint8 descriptors with the L2 distance computed in integers, the same blocking and ratio
+// test as matchHammingKnn2. If the float descriptors of query and train are given, the two best candidates are re-ranked
+// with their float distance before the ratio test. Match distances are L2 distances (not squared) like with NORM_L2.
+void matchL2U8Knn2(const cv::Mat &query, const cv::Mat &train, std::vector<cv::DMatch> &matches, float ratio, const cv::Mat &queryFloat,
+                   const cv::Mat &trainFloat)
+{
+    matches.clear();
+    if (query.empty() || train.empty())
+        return;
+    if (query.type() != CV_8U || train.type() != CV_8U || query.cols != train.cols)
+        CV_Error(cv::Error::StsBadArg, "integer L2 matching needs uint8 descriptors (CV_8U) of equal length");
+    bool bRerank = !queryFloat.empty() && !trainFloat.empty();
+    if (bRerank && (queryFloat.type() != CV_32F || trainFloat.type() != CV_32F || queryFloat.rows != query.rows ||
+                    trainFloat.rows != train.rows || queryFloat.cols != query.cols || trainFloat.cols != train.cols))
+        CV_Error(cv::Error::StsBadArg, "float descriptors for re-ranking must match the quantized descriptors");
+
+    L2Knn2BlockFn kernel = selectL2Knn2Kernel(query.cols, nullptr);
+    int nBlocks = (query.rows + hammingQueryBlock - 1) / hammingQueryBlock;
+    vector<cv::DMatch> blockMatches(query.rows);
+    vector<uchar> accepted(query.rows, 0);
+
+    cv::parallel_for_(cv::Range(0, nBlocks), [&](const cv::Range &range) {
+        L2Knn2Block block;
+        for (int b = range.start; b < range.end; ++b)
+        {
+            int q0 = b * hammingQueryBlock, q1 = min(query.rows, q0 + hammingQueryBlock);
+            for (int i = 0; i < q1 - q0; ++i)
+            {
+                block.best1[i] = block.best2[i] = INT_MAX;
+                block.idx1[i] = block.idx2[i] = -1;
+            }
+            kernel(query, train, q0, q1, block);
+            for (int q = q0; q < q1; ++q)
+            {
+                int i1 = block.idx1[q - q0], i2 = block.idx2[q - q0];
+                float d1 = std::sqrt((float)block.best1[q - q0]), d2 = std::sqrt((float)block.best2[q - q0]);
+                if (bRerank)
+                {
+                    const float *qf = queryFloat.ptr<float>(q);
+                    d1 = std::sqrt(cv::normL2Sqr<float, float>(qf, trainFloat.ptr<float>(i1), query.cols));
+                    if (i2 >= 0)
+                    {
+                        d2 = std::sqrt(cv::normL2Sqr<float, float>(qf, trainFloat.ptr<float>(i2), query.cols));
+                        if (d2 < d1)
+                        {
+                            std::swap(d1, d2);
+                            std::swap(i1, i2);
+                        }
+                    }
+                }
+                accepted[q] = ratio <= 0 || i2 < 0 || d1 < ratio * d2;
+                blockMatches[q] = cv::DMatch(q, i1, d1);
+            }
+        }
+    });
+
+    for (int q = 0; q < query.rows; ++q)
+        if (accepted[q])
+            matches.push_back(blockMatches[q]);
+}
@@ -0,0 +1,27 @@
+
+#ifndef matchingKernels_hpp
+#define matchingKernels_hpp
+
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+
+
+struct MihIndex { // multi-index hashing over 256-bit descriptors : one table per 16-bit substring (16 tables)
+    cv::Mat descriptors;          // indexed descriptors (CV_8U, 32 bytes per row)
+    std::vector<int> bucketStart; // [table * 65537 + key] first entry of bucket key in ids, buckets are contiguous
+    std::vector<int> ids;         // [table * n + k] descriptor ids ordered by the substring key of that table
+};
+
+void matchHammingKnn2(const cv::Mat &query, const cv::Mat &train, std::vector<cv::DMatch> &matches, float ratio);
+std::string hammingKernelName();
+void buildMihIndex(MihIndex &index, const cv::Mat &descriptors);
+void matchMihKnn2(const MihIndex &index, const cv::Mat &query, std::vector<cv::DMatch> &matches, float ratio);
+void benchmarkMih(int nQuery, int nTrain, int nFlippedBits);
+void benchmarkHammingKnn2(int nQuery, int nTrain);
+void quantizeDescriptors(const cv::Mat &descriptors, cv::Mat &quantized);
+void matchL2U8Knn2(const cv::Mat &query, const cv::Mat &train, std::vector<cv::DMatch> &matches, float ratio,
+                   const cv::Mat &queryFloat=cv::Mat(), const cv::Mat &trainFloat=cv::Mat());
+std::string l2U8KernelName();
+
+#endif /* matchingKernels_hpp */
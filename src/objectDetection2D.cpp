@@ -2,6 +2,7 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <map>
 
 #include <opencv2/dnn.hpp>
 #include <opencv2/imgproc.hpp>
@@ -12,10 +13,25 @@
 
 using namespace std;
 
+// Load a Darknet model and print the time spent parsing the cfg and converting the weights
+cv::dnn::Net loadDarknetModel(std::string modelConfiguration, std::string modelWeights)
+{
+    double t = (double)cv::getTickCount();
+    cv::dnn::Net net = cv::dnn::readNetFromDarknet(modelConfiguration, modelWeights);
+
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    cout << "YOLO model " << modelWeights << " loaded in " << 1000 * t / 1.0 << " ms" << endl;
+    return net;
+}
+
 // detects objects in an image using the YOLO library and a set of pre-trained objects from the COCO database;
-// a set of 80 classes is listed in "coco.names" and pre-trained weights are stored in "yolov3.weights"
+// a set of 80 classes is listed in "coco.names" and pre-trained weights are stored in "yolov3.weights".
+// If detROI is given, the network only runs on this image region (at native resolution, but at most inputSize x inputSize)
+// and the resulting boxes are mapped back into full image coordinates. The time spent in the network is returned in
+// inferenceTime [ms] if requested.
 void detectObjects(cv::Mat& img, std::vector<BoundingBox>& bBoxes, float confThreshold, float nmsThreshold, 
-                   std::string basePath, std::string classesFile, std::string modelConfiguration, std::string modelWeights, bool bVis)
+                   std::string basePath, std::string classesFile, std::string modelConfiguration, std::string modelWeights, bool bVis,
+                   cv::Rect *detROI, int inputSize, double *inferenceTime)
 {
     // load class names from file
     vector<string> classes;
@@ -23,20 +39,40 @@ void detectObjects(cv::Mat& img, std::vector<BoundingBox>& bBoxes, float confThr
     string line;
     while (getline(ifs, line)) classes.push_back(line);
     
-    // load neural network
-    cv::dnn::Net net = cv::dnn::readNetFromDarknet(modelConfiguration, modelWeights);
-    net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
-    net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+    // load neural network (only once per model, all subsequent calls reuse the already parsed network)
+    static map<string, cv::dnn::Net> loadedNets;
+    string netKey = modelConfiguration + "|" + modelWeights;
+    auto netIt = loadedNets.find(netKey);
+    if (netIt == loadedNets.end())
+    {
+        cv::dnn::Net newNet = loadDarknetModel(modelConfiguration, modelWeights);
+        newNet.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+        newNet.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+        netIt = loadedNets.insert(make_pair(netKey, newNet)).first;
+    }
+    cv::dnn::Net &net = netIt->second;
     
+    // select the image region the network runs on
+    cv::Rect netROI(0, 0, img.cols, img.rows);
+    cv::Size size = cv::Size(inputSize, inputSize);
+    if (detROI != nullptr && detROI->area() > 0)
+    {
+        netROI = *detROI & netROI;
+
+        // YOLO needs input dimensions which are a multiple of 32, do not upscale small ROIs beyond their native size
+        size.width = min(inputSize, ((netROI.width + 31) / 32) * 32);
+        size.height = min(inputSize, ((netROI.height + 31) / 32) * 32);
+    }
+    cv::Mat netImg = img(netROI);
+
     // generate 4D blob from input image
     cv::Mat blob;
     vector<cv::Mat> netOutput;
     double scalefactor = 1/255.0;
-    cv::Size size = cv::Size(416, 416);
     cv::Scalar mean = cv::Scalar(0,0,0);
     bool swapRB = false;
     bool crop = false;
-    cv::dnn::blobFromImage(img, blob, scalefactor, size, mean, swapRB, crop);
+    cv::dnn::blobFromImage(netImg, blob, scalefactor, size, mean, swapRB, crop);
     
     // Get names of output layers
     vector<cv::String> names;
@@ -48,8 +84,14 @@ void detectObjects(cv::Mat& img, std::vector<BoundingBox>& bBoxes, float confThr
         names[i] = layersNames[outLayers[i] - 1];
     
     // invoke forward propagation through network
+    double t = (double)cv::getTickCount();
     net.setInput(blob);
     net.forward(netOutput, names);
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    if (inferenceTime != nullptr)
+    {
+        *inferenceTime = 1000 * t / 1.0;
+    }
     
     // Scan through all bounding boxes and keep only the ones with high confidence
     vector<int> classIds; vector<float> confidences; vector<cv::Rect> boxes;
@@ -67,10 +109,10 @@ void detectObjects(cv::Mat& img, std::vector<BoundingBox>& bBoxes, float confThr
             if (confidence > confThreshold)
             {
                 cv::Rect box; int cx, cy;
-                cx = (int)(data[0] * img.cols);
-                cy = (int)(data[1] * img.rows);
-                box.width = (int)(data[2] * img.cols);
-                box.height = (int)(data[3] * img.rows);
+                cx = (int)(data[0] * netImg.cols) + netROI.x;
+                cy = (int)(data[1] * netImg.rows) + netROI.y;
+                box.width = (int)(data[2] * netImg.cols);
+                box.height = (int)(data[3] * netImg.rows);
                 box.x = cx - box.width/2; // left
                 box.y = cy - box.height/2; // top
                 
@@ -99,6 +141,10 @@ void detectObjects(cv::Mat& img, std::vector<BoundingBox>& bBoxes, float confThr
     if(bVis) {
         
         cv::Mat visImg = img.clone();
+        if (detROI != nullptr)
+        {
+            cv::rectangle(visImg, netROI, cv::Scalar(255, 0, 0), 1);
+        }
         for(auto it=bBoxes.begin(); it!=bBoxes.end(); ++it) {
             
             // Draw rectangle displaying the bounding box
@@ -127,3 +173,81 @@ void detectObjects(cv::Mat& img, std::vector<BoundingBox>& bBoxes, float confThr
         cv::waitKey(0); // wait for key to be pressed
     }
 }
+
+
+// Select the model / resolution profile for the next frame. Profiles are expected to be ordered from the cheapest to the
+// most accurate one. The most accurate profile whose predicted inference time fits into latencyBudget [ms] is chosen.
+// Profiles which have not been measured yet are predicted from a measured profile of the same model (cfg and weights)
+// scaled by the input area, profiles of other models are unknown until they ran once. An unmeasured current profile is
+// kept for one frame to measure it, if no profile is known to fit the cheapest one is used. The selection only moves up
+// by one profile per frame so that an expensive profile is never tried blindly.
+int selectYoloProfile(std::vector<YoloProfile> &profiles, int currProfile, double latencyBudget)
+{
+    if (profiles.empty())
+    {
+        return -1;
+    }
+    currProfile = max(0, min(currProfile, (int)profiles.size() - 1));
+    if (profiles[currProfile].avgInferenceTime < 0)
+    {
+        return currProfile;
+    }
+
+    int bestProfile = 0;
+    for (int i = 0; i < (int)profiles.size(); ++i)
+    {
+        double predictedTime = profiles[i].avgInferenceTime;
+        for (int j = 0; j < (int)profiles.size() && predictedTime < 0; ++j)
+        {
+            bool bSameModel = profiles[j].modelConfiguration == profiles[i].modelConfiguration &&
+                              profiles[j].modelWeights == profiles[i].modelWeights;
+            if (bSameModel && profiles[j].avgInferenceTime >= 0)
+            {
+                double areaRatio = (double)profiles[i].inputSize * profiles[i].inputSize /
+                                   ((double)profiles[j].inputSize * profiles[j].inputSize);
+                predictedTime = profiles[j].avgInferenceTime * areaRatio;
+            }
+        }
+
+        if (predictedTime >= 0 && predictedTime <= latencyBudget)
+        {
+            bestProfile = i;
+        }
+    }
+
+    // step up at most one profile per frame, step down immediately
+    return min(bestProfile, currProfile + 1);
+}
+
+// Remove profiles whose cfg or weights file does not exist (e.g. yolov3-tiny, which is not part of the repository).
+// Returns the index of the current profile in the reduced list, or 0 if the current profile was removed.
+int removeUnavailableYoloProfiles(std::vector<YoloProfile> &profiles, int currProfile)
+{
+    vector<YoloProfile> available;
+    int newProfile = 0;
+    for (int i = 0; i < (int)profiles.size(); ++i)
+    {
+        if (!ifstream(profiles[i].modelConfiguration.c_str()) || !ifstream(profiles[i].modelWeights.c_str()))
+        {
+            cout << "YOLO profile " << profiles[i].name << " skipped, model files not found" << endl;
+            continue;
+        }
+        if (i == currProfile)
+            newProfile = (int)available.size();
+        available.push_back(profiles[i]);
+    }
+    if (available.empty())
+        CV_Error(cv::Error::StsObjectNotFound, "no YOLO profile with existing model files");
+    profiles = available;
+    return newProfile;
+}
+
+// Update the running average of the inference time of a profile with a new measurement [ms]
+void updateYoloProfileTiming(YoloProfile &profile, double inferenceTime)
+{
+    double alpha = 0.3; // weight of the newest measurement
+    if (profile.avgInferenceTime < 0)
+        profile.avgInferenceTime = inferenceTime;
+    else
+        profile.avgInferenceTime = alpha * inferenceTime + (1 - alpha) * profile.avgInferenceTime;
+}
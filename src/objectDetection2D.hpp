@@ -4,10 +4,25 @@
 
 #include <stdio.h>
 #include <opencv2/core.hpp>
+#include <opencv2/dnn.hpp>
 
 #include "dataStructures.h"
 
+struct YoloProfile { // model / input resolution combination the object detector can switch between
+    std::string name;               // name reported per frame, e.g. "yolov3-tiny@320"
+    std::string modelConfiguration; // Darknet cfg file
+    std::string modelWeights;       // Darknet weights file
+    int inputSize;                  // square network input size in pixels (multiple of 32)
+    double avgInferenceTime;        // running average of the measured inference time in [ms], < 0 if not yet measured
+};
+
+cv::dnn::Net loadDarknetModel(std::string modelConfiguration, std::string modelWeights);
 void detectObjects(cv::Mat& img, std::vector<BoundingBox>& bBoxes, float confThreshold, float nmsThreshold, 
-                   std::string basePath, std::string classesFile, std::string modelConfiguration, std::string modelWeights, bool bVis);
+                   std::string basePath, std::string classesFile, std::string modelConfiguration, std::string modelWeights, bool bVis,
+                   cv::Rect *detROI=nullptr, int inputSize=416, double *inferenceTime=nullptr);
+
+int selectYoloProfile(std::vector<YoloProfile> &profiles, int currProfile, double latencyBudget);
+int removeUnavailableYoloProfiles(std::vector<YoloProfile> &profiles, int currProfile);
+void updateYoloProfileTiming(YoloProfile &profile, double inferenceTime);
 
 #endif /* objectDetection2D_hpp */
@@ -0,0 +1,75 @@
+
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <algorithm>
+
+#include "stageTiming.hpp"
+
+using namespace std;
+
+struct StageTiming { // timing statistics of a single processing stage
+    double coldTime;   // time of the very first invocation in [ms] (lazy allocations, kernel selection, ...)
+    double steadySum;  // sum of all later invocations in [ms]
+    double steadyMin, steadyMax;
+    int steadyCount;
+};
+
+static map<string, StageTiming> stageTimings;
+static bool bStageWarmUp = false; // samples are taken by a warm-up run
+
+// Record the time [ms] of one invocation of a processing stage. The first invocation of every stage is kept separately
+// as cold-start latency, all later invocations contribute to the steady-state statistics. Warm-up runs only record the
+// first invocation of a stage, later warm-ups (e.g. of the next detector / descriptor combination) are dropped.
+void recordStageTime(const std::string &stageName, double time)
+{
+    auto it = stageTimings.find(stageName);
+    if (it == stageTimings.end())
+    {
+        StageTiming timing = {time, 0.0, 1e9, 0.0, 0};
+        stageTimings.insert(make_pair(stageName, timing));
+        return;
+    }
+    if (bStageWarmUp)
+        return;
+
+    StageTiming &timing = it->second;
+    timing.steadySum += time;
+    timing.steadyMin = min(timing.steadyMin, time);
+    timing.steadyMax = max(timing.steadyMax, time);
+    timing.steadyCount++;
+}
+
+// Print cold-start versus steady-state latency for all recorded stages
+void printStageTimings()
+{
+    cout << "=============================================" << endl;
+    cout << left << setw(32) << "stage" << right << setw(12) << "cold [ms]" << setw(14) << "steady [ms]"
+         << setw(12) << "min [ms]" << setw(12) << "max [ms]" << setw(8) << "n" << setw(12) << "cold/steady" << endl;
+    cout << fixed << setprecision(2);
+    for (auto it = stageTimings.begin(); it != stageTimings.end(); ++it)
+    {
+        const StageTiming &timing = it->second;
+        cout << left << setw(32) << it->first << right << setw(12) << timing.coldTime;
+        if (timing.steadyCount > 0)
+        {
+            double steadyMean = timing.steadySum / timing.steadyCount;
+            cout << setw(14) << steadyMean << setw(12) << timing.steadyMin << setw(12) << timing.steadyMax
+                 << setw(8) << timing.steadyCount << setw(12) << (steadyMean > 0 ? timing.coldTime / steadyMean : 0.0);
+        }
+        else
+        {
+            cout << setw(14) << "-" << setw(12) << "-" << setw(12) << "-" << setw(8) << 0 << setw(12) << "-";
+        }
+        cout << endl;
+    }
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6);
+    cout << "=============================================" << endl;
+}
+
+// Mark the following samples as taken by a warm-up run (true) or by the timed frames (false)
+void setStageTimingWarmUp(bool bWarmUp)
+{
+    bStageWarmUp = bWarmUp;
+}
@@ -0,0 +1,11 @@
+
+#ifndef stageTiming_hpp
+#define stageTiming_hpp
+
+#include <string>
+
+void recordStageTime(const std::string &stageName, double time);
+void printStageTimings();
+void setStageTimingWarmUp(bool bWarmUp);
+
+#endif /* stageTiming_hpp */